@@ -0,0 +1,240 @@
+// Emits a synthetic CMake project with a compile_commands.json for scaling
+// benchmarks. The generated code mimics test/expr.cpp: small value structs
+// with static constructors and arithmetic members, plus free functions that
+// reference them. Everything is derived from --seed, so runs are reproducible.
+//
+//   tinysea_gen --out=/tmp/synth --tus=500 --identifiers=20000 --headers=50
+//               --fan-in=8 --refs=12
+
+#include <algorithm>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+struct GenOptions {
+    fs::path out = "synthetic";
+    unsigned tus = 100;
+    unsigned identifiers = 2000;
+    unsigned headers = 20;
+    unsigned fanIn = 5;
+    unsigned refs = 8;
+    unsigned functionsPerTU = 10;
+    unsigned seed = 1;
+};
+
+static bool parseArg(const std::string &arg, const char *name,
+                     unsigned &value) {
+    std::string prefix = std::string("--") + name + "=";
+    if (arg.rfind(prefix, 0) != 0)
+        return false;
+    value = std::stoul(arg.substr(prefix.size()));
+    return true;
+}
+
+static void usage() {
+    std::cerr << "usage: tinysea_gen --out=<dir> [--tus=N] [--identifiers=M]"
+                 " [--headers=H]\n"
+                 "                   [--fan-in=F] [--refs=R]"
+                 " [--functions-per-tu=K] [--seed=S]\n";
+}
+
+// one generated header: a value struct plus `functions` free functions
+struct Header {
+    std::string name;
+    std::string type;
+    unsigned functions;
+};
+
+static std::string functionName(unsigned header, unsigned index) {
+    return "Header" + std::to_string(header) + "Function" +
+           std::to_string(index);
+}
+
+static void writeHeader(const fs::path &path, unsigned index,
+                        const Header &header) {
+    std::ofstream out(path);
+    std::string guard = "SYNTHETIC_" + header.name + "_H";
+    const std::string &t = header.type;
+
+    out << "//-------------------------------------------------------------\n"
+        << "// Generated by tinysea_gen. Value type and helpers for header "
+        << index << ".\n"
+        << "//-------------------------------------------------------------\n"
+        << "#ifndef " << guard << "\n#define " << guard << "\n\n"
+        << "struct " << t << " {\n"
+        << "    double x, y, z;\n\n"
+        << "    static " << t << " From(double x, double y, double z) {\n"
+        << "        " << t << " r = {x, y, z};\n"
+        << "        return r;\n"
+        << "    }\n\n"
+        << "    " << t << " Plus(" << t << " b) const {\n"
+        << "        " << t << " r;\n"
+        << "        r.x = x + b.x;\n"
+        << "        r.y = y + b.y;\n"
+        << "        r.z = z + b.z;\n"
+        << "        return r;\n"
+        << "    }\n\n"
+        << "    " << t << " Minus(" << t << " b) const {\n"
+        << "        " << t << " r;\n"
+        << "        r.x = x - b.x;\n"
+        << "        r.y = y - b.y;\n"
+        << "        r.z = z - b.z;\n"
+        << "        return r;\n"
+        << "    }\n\n"
+        << "    double Dot(" << t << " b) const {\n"
+        << "        return x * b.x + y * b.y + z * b.z;\n"
+        << "    }\n"
+        << "};\n\n";
+
+    for (unsigned f = 0; f < header.functions; ++f) {
+        out << "inline double " << functionName(index, f)
+            << "(double value, double scale) {\n"
+            << "    " << t << " ve = " << t
+            << "::From(value, scale, " << f << ".0);\n"
+            << "    return ve.Plus(ve).Dot(ve) * scale;\n"
+            << "}\n\n";
+    }
+
+    out << "#endif // " << guard << "\n";
+}
+
+int main(int argc, char **argv) {
+    GenOptions opts;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg.rfind("--out=", 0) == 0) {
+            opts.out = arg.substr(6);
+        } else if (!parseArg(arg, "tus", opts.tus) &&
+                   !parseArg(arg, "identifiers", opts.identifiers) &&
+                   !parseArg(arg, "headers", opts.headers) &&
+                   !parseArg(arg, "fan-in", opts.fanIn) &&
+                   !parseArg(arg, "refs", opts.refs) &&
+                   !parseArg(arg, "functions-per-tu", opts.functionsPerTU) &&
+                   !parseArg(arg, "seed", opts.seed)) {
+            usage();
+            return 1;
+        }
+    }
+    if (opts.headers == 0 || opts.tus == 0) {
+        usage();
+        return 1;
+    }
+
+    fs::path root = fs::absolute(opts.out);
+    fs::create_directories(root / "include");
+    fs::create_directories(root / "src");
+    fs::create_directories(root / "build");
+
+    std::mt19937 rng(opts.seed);
+
+    // identifiers not used by TU-local functions are spread over the headers
+    unsigned tuIdentifiers = opts.tus * opts.functionsPerTU;
+    unsigned headerIdentifiers =
+        opts.identifiers > tuIdentifiers ? opts.identifiers - tuIdentifiers
+                                         : opts.headers;
+    std::vector<Header> headers;
+    for (unsigned h = 0; h < opts.headers; ++h) {
+        unsigned functions = headerIdentifiers / opts.headers +
+                             (h < headerIdentifiers % opts.headers ? 1 : 0);
+        headers.push_back({"header" + std::to_string(h),
+                           "ExprVector" + std::to_string(h),
+                           std::max(functions, 1u)});
+        writeHeader(root / "include" / (headers.back().name + ".h"), h,
+                    headers.back());
+    }
+
+    std::vector<fs::path> sources;
+    unsigned fanIn = std::min(opts.fanIn, opts.headers);
+    for (unsigned tu = 0; tu < opts.tus; ++tu) {
+        fs::path path = root / "src" / ("tu" + std::to_string(tu) + ".cpp");
+        sources.push_back(path);
+        std::ofstream out(path);
+
+        std::vector<unsigned> included(opts.headers);
+        for (unsigned h = 0; h < opts.headers; ++h)
+            included[h] = h;
+        std::shuffle(included.begin(), included.end(), rng);
+        included.resize(fanIn);
+
+        out << "//-------------------------------------------------------------"
+               "\n// Generated by tinysea_gen. Translation unit "
+            << tu << ".\n"
+            << "//-------------------------------------------------------------"
+               "\n";
+        for (unsigned h : included)
+            out << "#include \"../include/" << headers[h].name << ".h\"\n";
+        out << "\n";
+
+        for (unsigned f = 0; f < opts.functionsPerTU; ++f) {
+            out << "double Unit" << tu << "Function" << f
+                << "(double x, double y) {\n"
+                << "    double result = x;\n";
+            for (unsigned r = 0; r < opts.refs; ++r) {
+                const Header &h = headers[included[rng() % fanIn]];
+                unsigned index = &h - headers.data();
+                out << "    result = "
+                    << functionName(index, rng() % h.functions)
+                    << "(result, y);\n";
+            }
+            const Header &h = headers[included[f % fanIn]];
+            out << "    " << h.type << " ve = " << h.type
+                << "::From(x, y, result);\n"
+                << "    return ve.Minus(ve).Dot(ve) + result;\n"
+                << "}\n\n";
+        }
+    }
+
+    fs::path mainFile = root / "src" / "main.cpp";
+    {
+        std::ofstream out(mainFile);
+        out << "double Unit0Function0(double x, double y);\n\n"
+            << "int main() {\n"
+            << "    return Unit0Function0(1.0, 2.0) > 0 ? 0 : 1;\n"
+            << "}\n";
+    }
+    sources.push_back(mainFile);
+
+    {
+        std::ofstream out(root / "CMakeLists.txt");
+        out << "cmake_minimum_required(VERSION 3.20)\n"
+            << "project(synthetic CXX)\n\n"
+            << "set(CMAKE_CXX_STANDARD 20)\n"
+            << "set(CMAKE_EXPORT_COMPILE_COMMANDS ON)\n\n"
+            << "add_executable(synthetic\n";
+        for (const auto &source : sources)
+            out << "    " << fs::relative(source, root).string() << "\n";
+        out << ")\n";
+    }
+
+    // written directly so the project can be processed without running cmake
+    {
+        std::ofstream out(root / "build" / "compile_commands.json");
+        out << "[\n";
+        for (size_t i = 0; i < sources.size(); ++i) {
+            out << "  {\n"
+                << "    \"directory\": \"" << (root / "build").string()
+                << "\",\n"
+                << "    \"command\": \"c++ -std=c++20 -c "
+                << sources[i].string() << "\",\n"
+                << "    \"file\": \"" << sources[i].string() << "\"\n"
+                << "  }" << (i + 1 < sources.size() ? "," : "") << "\n";
+        }
+        out << "]\n";
+    }
+
+    unsigned totalIdentifiers = tuIdentifiers;
+    for (const auto &h : headers)
+        totalIdentifiers += h.functions + 1;
+
+    std::printf("{\"root\": \"%s\", \"tus\": %zu, \"headers\": %u, "
+                "\"identifiers\": %u}\n",
+                root.string().c_str(), sources.size(), opts.headers,
+                totalIdentifiers);
+    return 0;
+}
@@ -0,0 +1,131 @@
+#!/usr/bin/env python3
+"""Compressed output size of tinysea under each --naming strategy.
+
+Runs tinysea over test/expr.cpp (through --stdin) and over a synthetic project
+from tinysea_gen, once per naming strategy and each time with a fresh mapping
+file, then compresses the output with gzip and zstd. Raw size should be
+nearly identical across strategies; the compressed columns are the point.
+
+    bench/naming_eval.py --tinysea=build/tinysea --gen=build/tinysea_gen \\
+        --expr-arg=-I/boot/home/solvespace/src --out=naming.json
+
+zstd sizes come from the zstandard module if it is installed, otherwise from
+the zstd command line tool; the column is left out if neither is available.
+"""
+
+import argparse
+import gzip
+import json
+import os
+import shutil
+import subprocess
+import sys
+import tempfile
+
+STRATEGIES = ["sequential", "cooccurrence"]
+REPO = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+
+
+def zstd_size(data, level):
+    try:
+        import zstandard
+        return len(zstandard.ZstdCompressor(level=level).compress(data))
+    except ImportError:
+        pass
+    if shutil.which("zstd"):
+        out = subprocess.run(["zstd", f"-{level}", "-c", "-q"], input=data,
+                             check=True, capture_output=True)
+        return len(out.stdout)
+    return None
+
+
+def sizes(data, args):
+    return {
+        "raw": len(data),
+        "gzip": len(gzip.compress(data, compresslevel=args.gzip_level)),
+        "zstd": zstd_size(data, args.zstd_level),
+    }
+
+
+def run_expr(args, strategy, workdir):
+    source = os.path.join(REPO, "test", "expr.cpp")
+    mapping = os.path.join(workdir, f"expr-{strategy}.json")
+    cmd = [
+        args.tinysea,
+        "--stdin",
+        "--stdin-filename=expr.cpp",
+        f"--mapping={mapping}",
+        f"--naming={strategy}",
+    ] + [f"--extra-arg={a}" for a in args.expr_arg]
+    with open(source, "rb") as f:
+        out = subprocess.run(cmd, stdin=f, check=True, capture_output=True)
+    return out.stdout
+
+
+def run_synthetic(args, strategy, workdir):
+    # tinysea rewrites sources in place, so every run gets a fresh project
+    root = os.path.join(workdir, f"synthetic-{strategy}")
+    shutil.rmtree(root, ignore_errors=True)
+    subprocess.run([
+        args.gen,
+        f"--out={root}",
+        f"--tus={args.tus}",
+        f"--identifiers={args.identifiers}",
+        f"--seed={args.seed}",
+    ], check=True, capture_output=True)
+
+    output = os.path.join(root, "transformed.cpp")
+    subprocess.run([
+        args.tinysea,
+        f"--cmake-project={os.path.join(root, 'build')}",
+        f"--output={output}",
+        f"--naming={strategy}",
+        f"-j={args.jobs}",
+    ], check=True, stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL)
+    with open(output, "rb") as f:
+        return f.read()
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--tinysea", required=True)
+    parser.add_argument("--gen", required=True)
+    parser.add_argument("--expr-arg", action="append", default=[],
+                        help="extra compiler argument for test/expr.cpp")
+    parser.add_argument("--tus", type=int, default=200)
+    parser.add_argument("--identifiers", type=int, default=4000)
+    parser.add_argument("--seed", type=int, default=1)
+    parser.add_argument("-j", "--jobs", type=int, default=1)
+    parser.add_argument("--gzip-level", type=int, default=9)
+    parser.add_argument("--zstd-level", type=int, default=19)
+    parser.add_argument("--workdir", default=None)
+    parser.add_argument("--out", default="naming.json")
+    args = parser.parse_args()
+
+    workdir = args.workdir or tempfile.mkdtemp(prefix="tinysea-naming-")
+    corpora = [("expr.cpp", run_expr), ("synthetic", run_synthetic)]
+    results = []
+
+    print(f"{'corpus':<10} {'strategy':<13} {'raw':>10} {'gzip':>10} "
+          f"{'zstd':>10}")
+    for corpus, run in corpora:
+        for strategy in STRATEGIES:
+            try:
+                data = run(args, strategy, workdir)
+            except subprocess.CalledProcessError as e:
+                print(f"{corpus}: tinysea failed ({e.returncode})",
+                      file=sys.stderr)
+                break
+            r = {"corpus": corpus, "strategy": strategy, **sizes(data, args)}
+            results.append(r)
+            zstd = r["zstd"] if r["zstd"] is not None else "-"
+            print(f"{corpus:<10} {strategy:<13} {r['raw']:>10} "
+                  f"{r['gzip']:>10} {zstd:>10}")
+            sys.stdout.flush()
+
+    with open(args.out, "w") as f:
+        json.dump(results, f, indent=2)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,158 @@
+#include "stdafx.h"
+
+#include <benchmark/benchmark.h>
+
+#include "llvm/Support/FileSystem.h"
+
+// Microbenchmarks for the Renamer hot paths. Run with
+//   tinysea_bench --benchmark_out=bench.json --benchmark_out_format=json
+// to get machine-readable results for regression gating.
+
+static std::vector<std::string> makeQualifiedNames(size_t count) {
+    std::vector<std::string> names;
+    names.reserve(count);
+    for (size_t i = 0; i < count; ++i)
+        names.push_back("ns::Class" + std::to_string(i % 97) + "::member" +
+                        std::to_string(i));
+    return names;
+}
+
+// writes a mapping file with `count` entries and returns its path
+static std::string writeMappingFile(size_t count) {
+    llvm::SmallString<128> path;
+    llvm::sys::fs::createTemporaryFile("tinysea-bench", "json", path);
+
+    Renamer renamer;
+    for (const auto &name : makeQualifiedNames(count))
+        renamer.getShortName(name);
+    renamer.saveMappings(path.str().str());
+    return path.str().str();
+}
+
+static void BM_GenerateName(benchmark::State &state) {
+    unsigned index = 0;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(Renamer::generateName(index));
+        index = (index + 7919) % 20000000;
+    }
+}
+BENCHMARK(BM_GenerateName);
+
+static void BM_ShortNameToIndex(benchmark::State &state) {
+    std::vector<std::string> names;
+    for (unsigned i = 0; i < 4096; ++i)
+        names.push_back(Renamer::generateName(i * 4099));
+
+    size_t i = 0;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(Renamer::shortNameToIndex(names[i]));
+        i = (i + 1) & 4095;
+    }
+}
+BENCHMARK(BM_ShortNameToIndex);
+
+static void BM_GetShortNameHit(benchmark::State &state) {
+    auto names = makeQualifiedNames(state.range(0));
+    Renamer renamer;
+    for (const auto &name : names)
+        renamer.getShortName(name);
+
+    size_t i = 0;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(renamer.getShortName(names[i]));
+        if (++i == names.size())
+            i = 0;
+    }
+}
+BENCHMARK(BM_GetShortNameHit)->Arg(1000)->Arg(100000);
+
+static void BM_GetShortNameMiss(benchmark::State &state) {
+    // enough distinct names that the map keeps growing for a typical run;
+    // the renamer is rebuilt outside the timed region when they run out
+    auto names = makeQualifiedNames(1 << 20);
+    auto renamer = std::make_unique<Renamer>();
+
+    size_t i = 0;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(renamer->getShortName(names[i]));
+        if (++i == names.size()) {
+            state.PauseTiming();
+            renamer = std::make_unique<Renamer>();
+            i = 0;
+            state.ResumeTiming();
+        }
+    }
+}
+BENCHMARK(BM_GetShortNameMiss);
+
+static void BM_ReservedKeyword(benchmark::State &state) {
+    // mix of keywords and ordinary short names, as seen during generation
+    const std::vector<std::string> candidates = {"do", "dp", "if", "ig",
+                                                 "int", "inu", "for", "fos"};
+    Renamer renamer;
+
+    size_t i = 0;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(renamer.isReservedKeyword(candidates[i]));
+        i = (i + 1) % candidates.size();
+    }
+}
+BENCHMARK(BM_ReservedKeyword);
+
+static void BM_LoadMappings(benchmark::State &state) {
+    std::string path = writeMappingFile(state.range(0));
+
+    for (auto _ : state) {
+        Renamer renamer;
+        renamer.loadMappings(path);
+        benchmark::DoNotOptimize(renamer.hasMappings()); // forces the parse
+    }
+
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+    llvm::sys::fs::remove(path);
+}
+BENCHMARK(BM_LoadMappings)
+    ->Arg(10000)
+    ->Arg(1000000)
+    ->Arg(10000000)
+    ->Unit(benchmark::kMillisecond);
+
+static void BM_SaveMappings(benchmark::State &state) {
+    Renamer renamer;
+    for (const auto &name : makeQualifiedNames(state.range(0)))
+        renamer.getShortName(name);
+
+    llvm::SmallString<128> path;
+    llvm::sys::fs::createTemporaryFile("tinysea-bench", "json", path);
+
+    for (auto _ : state)
+        renamer.saveMappings(path.str().str());
+
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+    llvm::sys::fs::remove(path);
+}
+BENCHMARK(BM_SaveMappings)
+    ->Arg(10000)
+    ->Arg(1000000)
+    ->Arg(10000000)
+    ->Unit(benchmark::kMillisecond);
+
+static void BM_CollectTransformedCode(benchmark::State &state) {
+    const std::string content(state.range(0), 'x');
+    Renamer renamer;
+
+    size_t collected = 0;
+    for (auto _ : state) {
+        renamer.collectTransformedCode("src/expr.cpp", content);
+        if (++collected % 4096 == 0) {
+            state.PauseTiming();
+            renamer.takeCombinedOutput();
+            state.ResumeTiming();
+        }
+    }
+
+    state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_CollectTransformedCode)->Arg(64)->Arg(4096);
+
+BENCHMARK_MAIN();
@@ -0,0 +1,117 @@
+#!/usr/bin/env python3
+"""End-to-end scaling harness for tinysea.
+
+Generates synthetic projects with tinysea_gen, runs tinysea over each one at
+several thread counts and records throughput, peak RSS and output size. The
+results are written as JSON (one record per run) and printed as a table.
+
+    bench/scaling.py --tinysea=build/tinysea --gen=build/tinysea_gen \\
+        --tus=100,400,1600 --threads=1,2,4,8 --out=scaling.json
+"""
+
+import argparse
+import json
+import os
+import shutil
+import subprocess
+import sys
+import tempfile
+import time
+
+
+def csv_ints(value):
+    return [int(v) for v in value.split(",") if v]
+
+
+def generate(gen, root, tus, args):
+    cmd = [
+        gen,
+        f"--out={root}",
+        f"--tus={tus}",
+        f"--identifiers={args.identifiers_per_tu * tus}",
+        f"--headers={args.headers}",
+        f"--fan-in={args.fan_in}",
+        f"--refs={args.refs}",
+        f"--seed={args.seed}",
+    ]
+    out = subprocess.run(cmd, check=True, capture_output=True, text=True)
+    return json.loads(out.stdout)
+
+
+def run_once(args, tus, threads, workdir):
+    # tinysea rewrites sources in place, so every run gets a fresh project
+    root = os.path.join(workdir, f"tus{tus}-j{threads}")
+    shutil.rmtree(root, ignore_errors=True)
+    project = generate(args.gen, root, tus, args)
+
+    output = os.path.join(root, "transformed.cpp")
+    stats_file = os.path.join(root, "stats.json")
+    cmd = [
+        args.tinysea,
+        f"--cmake-project={os.path.join(root, 'build')}",
+        f"--output={output}",
+        f"--stats={stats_file}",
+        f"-j={threads}",
+    ]
+
+    start = time.monotonic()
+    subprocess.run(cmd, check=True, stdout=subprocess.DEVNULL,
+                   stderr=subprocess.DEVNULL)
+    seconds = time.monotonic() - start
+
+    with open(stats_file) as f:
+        stats = json.load(f)
+    counters = stats["counters"]
+    identifiers = counters["declsVisited"] + counters["referencesRewritten"]
+
+    return {
+        "tus": project["tus"],
+        "identifiers": project["identifiers"],
+        "threads": threads,
+        "seconds": seconds,
+        "tusPerSecond": project["tus"] / seconds,
+        "identifiersPerSecond": identifiers / seconds,
+        "peakRSSKB": stats["peakRSSKB"],
+        "outputBytes": os.path.getsize(output) if os.path.exists(output)
+        else 0,
+        "counters": counters,
+    }
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--tinysea", required=True)
+    parser.add_argument("--gen", required=True)
+    parser.add_argument("--tus", type=csv_ints, default=[50, 200, 800])
+    parser.add_argument("--threads", type=csv_ints, default=[1, 2, 4, 8])
+    parser.add_argument("--identifiers-per-tu", type=int, default=20)
+    parser.add_argument("--headers", type=int, default=40)
+    parser.add_argument("--fan-in", type=int, default=8)
+    parser.add_argument("--refs", type=int, default=8)
+    parser.add_argument("--seed", type=int, default=1)
+    parser.add_argument("--workdir", default=None)
+    parser.add_argument("--out", default="scaling.json")
+    args = parser.parse_args()
+
+    workdir = args.workdir or tempfile.mkdtemp(prefix="tinysea-scaling-")
+    results = []
+
+    print(f"{'TUs':>6} {'threads':>7} {'seconds':>9} {'TUs/s':>9} "
+          f"{'idents/s':>10} {'peak RSS MB':>11} {'output KB':>10}")
+    for tus in args.tus:
+        for threads in args.threads:
+            r = run_once(args, tus, threads, workdir)
+            results.append(r)
+            print(f"{r['tus']:>6} {threads:>7} {r['seconds']:>9.2f} "
+                  f"{r['tusPerSecond']:>9.1f} "
+                  f"{r['identifiersPerSecond']:>10.0f} "
+                  f"{r['peakRSSKB'] / 1024:>11.1f} "
+                  f"{r['outputBytes'] / 1024:>10.1f}")
+            sys.stdout.flush()
+
+    with open(args.out, "w") as f:
+        json.dump(results, f, indent=2)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,126 @@
+#!/usr/bin/env python3
+"""Downstream compile-time harness for --unity-chunks.
+
+Generates the same synthetic project twice with tinysea_gen. The first copy
+is compiled as it is, one job per translation unit. The second is
+minified into N unity chunks, which are compiled the same way. Both are
+compiled with the same flags and parallelism. Wall and summed CPU seconds
+for each build are written as JSON and printed as a table.
+
+    bench/unity_compile.py --tinysea=build/tinysea --gen=build/tinysea_gen \\
+        --tus=400 --chunks=1,4,8,16 --jobs=8 --out=unity.json
+"""
+
+import argparse
+import glob
+import json
+import os
+import shlex
+import shutil
+import subprocess
+import tempfile
+import time
+from concurrent.futures import ThreadPoolExecutor
+
+
+def csv_ints(value):
+    return [int(v) for v in value.split(",") if v]
+
+
+def generate(gen, root, args):
+    shutil.rmtree(root, ignore_errors=True)
+    cmd = [
+        gen,
+        f"--out={root}",
+        f"--tus={args.tus}",
+        f"--identifiers={args.identifiers_per_tu * args.tus}",
+        f"--headers={args.headers}",
+        f"--fan-in={args.fan_in}",
+        f"--refs={args.refs}",
+        f"--seed={args.seed}",
+    ]
+    subprocess.run(cmd, check=True, capture_output=True, text=True)
+    with open(os.path.join(root, "build", "compile_commands.json")) as f:
+        return json.load(f)
+
+
+def compile_command(entry, source, compiler):
+    # the entry's flags with its source swapped out and the object discarded
+    words = shlex.split(entry["command"])
+    flags = [w for w in words[1:] if w != entry["file"]]
+    return [compiler or words[0], *flags, source, "-o", os.devnull]
+
+
+def build(commands, jobs):
+    def run(cmd):
+        start = time.monotonic()
+        subprocess.run(cmd, check=True, stdout=subprocess.DEVNULL)
+        return time.monotonic() - start
+
+    start = time.monotonic()
+    with ThreadPoolExecutor(max_workers=jobs) as pool:
+        cpu = sum(pool.map(run, commands))
+    return time.monotonic() - start, cpu
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--tinysea", required=True)
+    parser.add_argument("--gen", required=True)
+    parser.add_argument("--compiler", default=None,
+                        help="override the compiler in compile_commands")
+    parser.add_argument("--tus", type=int, default=400)
+    parser.add_argument("--chunks", type=csv_ints, default=[1, 4, 8, 16])
+    parser.add_argument("--jobs", type=int, default=os.cpu_count())
+    parser.add_argument("--identifiers-per-tu", type=int, default=20)
+    parser.add_argument("--headers", type=int, default=40)
+    parser.add_argument("--fan-in", type=int, default=8)
+    parser.add_argument("--refs", type=int, default=8)
+    parser.add_argument("--seed", type=int, default=1)
+    parser.add_argument("--workdir", default=None)
+    parser.add_argument("--out", default="unity.json")
+    args = parser.parse_args()
+
+    workdir = args.workdir or tempfile.mkdtemp(prefix="tinysea-unity-")
+    results = []
+
+    baseline = generate(args.gen, os.path.join(workdir, "baseline"), args)
+    wall, cpu = build([compile_command(e, e["file"], args.compiler)
+                       for e in baseline], args.jobs)
+    results.append({"build": "unminified", "units": len(baseline),
+                    "wallSeconds": wall, "cpuSeconds": cpu})
+
+    for chunks in args.chunks:
+        # tinysea rewrites sources in place, so every run gets a fresh copy
+        root = os.path.join(workdir, f"chunks{chunks}")
+        entries = generate(args.gen, root, args)
+        output = os.path.join(root, "unity.cpp")
+        subprocess.run([
+            args.tinysea,
+            f"--cmake-project={os.path.join(root, 'build')}",
+            f"--output={output}",
+            f"--unity-chunks={chunks}",
+            f"--stats={os.path.join(root, 'stats.json')}",
+            f"-j={args.jobs}",
+        ], check=True, stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL)
+
+        files = sorted(glob.glob(os.path.join(root, "unity.*.cpp")))
+        wall, cpu = build([compile_command(entries[0], f, args.compiler)
+                           for f in files], args.jobs)
+        results.append({"build": f"unity-chunks={chunks}",
+                        "units": len(files), "wallSeconds": wall,
+                        "cpuSeconds": cpu})
+
+    print(f"{'build':>18} {'units':>6} {'wall s':>8} {'cpu s':>8} "
+          f"{'speedup':>8}")
+    for r in results:
+        r["speedup"] = results[0]["wallSeconds"] / r["wallSeconds"]
+        print(f"{r['build']:>18} {r['units']:>6} {r['wallSeconds']:>8.2f} "
+              f"{r['cpuSeconds']:>8.2f} {r['speedup']:>8.2f}")
+
+    with open(args.out, "w") as f:
+        json.dump(results, f, indent=2)
+
+
+if __name__ == "__main__":
+    main()
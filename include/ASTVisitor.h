@@ -8,14 +8,69 @@ class CustomASTVisitor : public RecursiveASTVisitor<CustomASTVisitor> {
     Renamer &renamer;
     SourceManager &sm;
     Rewriter &rewriter;
+    const ToolOptions &options;
+    // the renamer's, which a loaded mapping may have set
+    NamingStrategy naming;
     std::set<Decl *> processedDecls;
+    std::set<unsigned> processedLiterals;
+    // top-level declaration whose body is being traversed, for the
+    // reference graph
+    Decl *currentOwner = nullptr;
+    // source ranges already claimed by an emitted section, per file, and
+    // the declarations whose text is taken once their traversal finishes
+    std::map<FileID, IntervalSet> emittedRanges;
+    std::set<Decl *> pendingSections;
+    // isRenamable verdicts, policy included, by canonical declaration, and
+    // the name locations already rewritten
+    llvm::DenseMap<const Decl *, bool> renamableDecls;
+    llvm::DenseSet<unsigned> renamedLocs;
+    // isRewritable verdicts for files other than the main file
+    llvm::DenseMap<FileID, bool> rewritableFiles;
 
 public:
-    CustomASTVisitor(ASTContext &ctx, Renamer &r, Rewriter &rw);
+    CustomASTVisitor(ASTContext &ctx, Renamer &r, Rewriter &rw,
+                     const ToolOptions &opts);
     bool VisitNamedDecl(NamedDecl *decl);
     bool VisitDeclRefExpr(DeclRefExpr *expr);
+    bool VisitUsingDecl(UsingDecl *decl);
+    bool VisitSizeOfPackExpr(SizeOfPackExpr *expr);
     bool TraverseDecl(Decl *D);
+    bool TraverseLambdaCapture(LambdaExpr *lambda, const LambdaCapture *capture,
+                               Expr *init);
+
+    bool VisitIntegerLiteral(IntegerLiteral *literal);
+    bool VisitFloatingLiteral(FloatingLiteral *literal);
+    bool VisitUserDefinedLiteral(UserDefinedLiteral *literal);
+    bool VisitImplicitCastExpr(ImplicitCastExpr *cast);
+
+    bool VisitMemberExpr(MemberExpr *expr);
+    bool VisitCXXConstructExpr(CXXConstructExpr *expr);
+    bool VisitTagTypeLoc(TagTypeLoc loc);
+    bool VisitTypedefTypeLoc(TypedefTypeLoc loc);
+    bool VisitInjectedClassNameTypeLoc(InjectedClassNameTypeLoc loc);
+    bool VisitOverloadExpr(OverloadExpr *expr);
+    bool VisitCXXDependentScopeMemberExpr(CXXDependentScopeMemberExpr *expr);
+    bool VisitDependentScopeDeclRefExpr(DependentScopeDeclRefExpr *expr);
+    bool VisitTemplateSpecializationTypeLoc(TemplateSpecializationTypeLoc loc);
 
 private:
-    bool shouldSkip(NamedDecl *decl);
+    bool isRewritable(FileID file);
+    bool isRenamable(NamedDecl *decl);
+    bool hasRenamableKind(NamedDecl *decl) const;
+    bool renameAt(SourceLocation loc, NamedDecl *decl);
+    llvm::StringRef tokenAt(SourceLocation loc) const;
+    SourceLocation nameLocAt(SourceLocation loc, llvm::StringRef name) const;
+    bool isPreserved(NamedDecl *decl);
+    bool claimRange(SourceRange range);
+    void emitSection(NamedDecl *decl);
+    void markSection(SourceRange range, const std::string &owner);
+    void recordReference(NamedDecl *target);
+    void recordNameUse(DeclarationName name);
+    std::string namingContext() const;
+    bool isFileLocal(NamedDecl *decl) const;
+    std::string renameKey(NamedDecl *decl) const;
+    std::string ownerKey(Decl *decl) const;
+    void recordDeclaration(NamedDecl *decl, const std::string &owner);
+    void replaceLiteral(SourceLocation loc, const std::string &spelling,
+                        Stats::Counter bytesSaved);
 };
\ No newline at end of file
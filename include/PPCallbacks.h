@@ -7,40 +7,95 @@ class CustomPPCallbacks : public PPCallbacks {
     Renamer &renamer;
     SourceManager &sm;
     Rewriter &rewriter;
-    std::set<std::string> processedMacros;
+    const ToolOptions &options;
+    Preprocessor &pp;
+    std::vector<FileEntryRef> includedFiles;
+
+    // macros defined in the main file, in definition order, and the short
+    // name each one ends up with. IdentifierInfo is interned per TU, so
+    // nothing here copies a macro name
+    std::vector<std::pair<const IdentifierInfo *, const MacroInfo *>>
+        definitions;
+    llvm::DenseMap<const IdentifierInfo *, llvm::StringRef> projectMacros;
+    // every spelling of a macro name in the main file. These are resolved at
+    // the end of the file, since #ifdef can name a macro defined further down
+    std::vector<std::pair<const IdentifierInfo *, SourceLocation>> macroUses;
+    // names that something outside the main file defines, tests or expands
+    // (NDEBUG and friends); renaming those would change what it sees
+    llvm::DenseSet<const IdentifierInfo *> externalUses;
+    llvm::DenseSet<unsigned> rewrittenLocs;
+
+    void recordUse(const Token &nameTok);
+    void renameMacros();
+    void renameDefinition(const MacroInfo &info);
+    bool replaceName(SourceLocation loc, unsigned length,
+                     llvm::StringRef newName);
 
 public:
-    CustomPPCallbacks(Renamer &r, SourceManager &sm, Rewriter &rw);
+    CustomPPCallbacks(Renamer &r, SourceManager &sm, Rewriter &rw,
+                      const ToolOptions &opts, Preprocessor &pp);
     void MacroDefined(const Token &MacroNameTok,
                       const MacroDirective *MD) override;
+    void MacroUndefined(const Token &MacroNameTok, const MacroDefinition &MD,
+                        const MacroDirective *Undef) override;
     void MacroExpands(const Token &MacroNameTok, const MacroDefinition &MD,
                       SourceRange Range, const MacroArgs *Args) override;
+    void Defined(const Token &MacroNameTok, const MacroDefinition &MD,
+                 SourceRange Range) override;
+    void Ifdef(SourceLocation Loc, const Token &MacroNameTok,
+               const MacroDefinition &MD) override;
+    void Ifndef(SourceLocation Loc, const Token &MacroNameTok,
+                const MacroDefinition &MD) override;
+    void Elifdef(SourceLocation Loc, const Token &MacroNameTok,
+                 const MacroDefinition &MD) override;
+    void Elifndef(SourceLocation Loc, const Token &MacroNameTok,
+                  const MacroDefinition &MD) override;
+    void InclusionDirective(SourceLocation HashLoc, const Token &IncludeTok,
+                            StringRef FileName, bool IsAngled,
+                            CharSourceRange FilenameRange,
+                            OptionalFileEntryRef File, StringRef SearchPath,
+                            StringRef RelativePath,
+                            const Module *SuggestedModule, bool ModuleImported,
+                            SrcMgr::CharacteristicKind FileType) override;
+    void FileChanged(SourceLocation Loc, FileChangeReason Reason,
+                     SrcMgr::CharacteristicKind FileType,
+                     FileID PrevFID) override;
+    void EndOfMainFile() override;
 };
 
 class CustomASTConsumer : public clang::ASTConsumer {
     std::unique_ptr<CustomASTVisitor> visitor;
+    double &traverseMs;
 
 public:
-    CustomASTConsumer(clang::ASTContext &ctx, Renamer &r, clang::Rewriter &rw);
+    CustomASTConsumer(clang::ASTContext &ctx, Renamer &r, clang::Rewriter &rw,
+                      const ToolOptions &opts, double &traverseMs);
     void HandleTranslationUnit(clang::ASTContext &context) override;
 };
 
 class CustomFrontendAction : public clang::ASTFrontendAction {
     Renamer &renamer;
+    const ToolOptions &options;
     std::unique_ptr<Rewriter> rewriter;
+    Stats::TUTimings timings;
 
 public:
-    CustomFrontendAction(Renamer &r);
+    CustomFrontendAction(Renamer &r, const ToolOptions &opts);
     std::unique_ptr<clang::ASTConsumer>
     CreateASTConsumer(clang::CompilerInstance &ci, llvm::StringRef) override;
     void ExecuteAction() override;
+
+private:
+    void emitRewrittenBuffers();
+    void collectForVerify(FileID file, std::string content);
 };
 
 class CustomActionFactory : public clang::tooling::FrontendActionFactory {
     Renamer &renamer;
+    const ToolOptions &options;
 
 public:
-    CustomActionFactory(Renamer &r);
+    CustomActionFactory(Renamer &r, const ToolOptions &opts);
 
     std::unique_ptr<clang::FrontendAction> create() override;
 };
@@ -48,11 +103,13 @@ public:
 class CustomFrontendActionFactory
     : public clang::tooling::FrontendActionFactory {
     Renamer &renamer;
+    const ToolOptions &options;
 
 public:
-    explicit CustomFrontendActionFactory(Renamer &r) : renamer(r) {}
+    CustomFrontendActionFactory(Renamer &r, const ToolOptions &opts)
+        : renamer(r), options(opts) {}
 
     std::unique_ptr<clang::FrontendAction> create() override {
-        return std::make_unique<CustomFrontendAction>(renamer);
+        return std::make_unique<CustomFrontendAction>(renamer, options);
     }
 };
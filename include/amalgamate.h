@@ -0,0 +1,38 @@
+#pragma once
+
+// One #include seen while preprocessing, recorded for --amalgamate. Lines
+// are 1-based and refer to the includer; renaming never adds or removes
+// lines, so they stay valid for the rewritten text.
+struct IncludeDirective {
+    unsigned firstLine = 0;
+    unsigned lastLine = 0;
+    std::string target;
+    bool isSystem = false;
+};
+
+struct IncludedFile {
+    std::map<unsigned, IncludeDirective> directives; // keyed by firstLine
+    bool guarded = false; // include guard or #pragma once
+};
+
+using IncludeGraph = std::map<std::string, IncludedFile>;
+
+// absolute, with `.` and `..` removed, so one header reached through
+// different relative paths maps to one key
+std::string normalizedPath(llvm::StringRef path);
+
+// the deepest directory, with a trailing '/', that contains every one of
+// `paths` (normalized, directories ending in '/'); empty if there are none
+std::string commonDirectory(const std::vector<std::string> &paths);
+
+// true if `path` lies under `root` as returned by commonDirectory; an empty
+// root holds everything
+bool isUnder(llvm::StringRef path, llvm::StringRef root);
+
+// Builds a single translation unit from `mainFiles`. Project headers are
+// inlined at their first inclusion and again only if they are unguarded,
+// guarded system headers are included once, and `#pragma once` lines are
+// dropped. Text comes from `rewritten` when present and from disk otherwise.
+std::string amalgamate(const std::vector<std::string> &mainFiles,
+                       const IncludeGraph &graph,
+                       const std::map<std::string, std::string> &rewritten);
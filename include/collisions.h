@@ -0,0 +1,49 @@
+#pragma once
+
+// Every identifier spelled in a non-project header seen during the run (a
+// system header, or one outside the project root), so that
+// generated short names never shadow or get expanded by something the
+// rewritten code can also see. A Bloom filter answers the common "not
+// there" case without locking; maybes are settled by the exact set.
+// Internally synchronized: parse workers add names while Renamer queries.
+class ExternalNames {
+    static constexpr unsigned filterBits = 1u << 24; // 2 MiB
+    static constexpr unsigned numHashes = 4;
+
+    // allocated on first insert, so runs without system headers pay nothing
+    std::unique_ptr<std::atomic<uint64_t>[]> filter;
+    std::atomic<bool> empty = true;
+
+    mutable std::mutex mutex;
+    llvm::StringSet<> names;
+    llvm::StringSet<> scannedFiles;
+
+    bool mayContain(uint64_t hash) const;
+
+public:
+    // true the first time `path` is seen, i.e. when the caller should scan it
+    bool claimFile(llvm::StringRef path);
+
+    void insert(llvm::ArrayRef<llvm::StringRef> identifiers);
+    bool contains(llvm::StringRef identifier) const;
+
+    size_t size() const;
+    // every name inserted, sorted, for the mapping metadata of a shard
+    std::vector<std::string> sorted() const;
+};
+
+// appends the identifiers spelled in `text` (comments and literals skipped)
+void lexIdentifiers(llvm::StringRef text, const clang::LangOptions &langOpts,
+                    std::vector<llvm::StringRef> &out);
+
+// Lexes every file in the closures of `sources` on `jobs` threads: those
+// outside `projectRoot` into `external` when `guardExternal` is set, the
+// others into `project`, which may be called concurrently. Files are
+// claimed in `external` either way. Run before the first TU is parsed, so
+// no short name is handed out that a file read later in the run spells.
+void scanIncludeClosures(
+    const DependencyCache &cache, const std::vector<std::string> &sources,
+    const std::string &projectRoot, unsigned jobs, bool guardExternal,
+    ExternalNames &external,
+    llvm::function_ref<void(llvm::ArrayRef<llvm::StringRef>)> project,
+    Stats &stats);
@@ -0,0 +1,49 @@
+#pragma once
+
+enum class OutputCompression { None, Zlib, Zstd };
+
+// Container written by --output-compression. Every frame is compressed on
+// its own, so one section can be found through the index and decompressed
+// without touching the rest:
+//
+//   header   "TSEA" u8 version
+//   frame    u8 format, u32 nameSize, name, u64 rawSize, u64 packedSize, data
+//   index    u32 count, { u32 nameSize, name, u64 frameOffset } * count
+//   trailer  u64 indexOffset, "AEST"
+//
+// Integers are little-endian. A frame that doesn't get smaller is stored with
+// format 0 (uncompressed). Decompressing every frame in order reproduces the
+// uncompressed file byte for byte.
+class FramedWriter {
+    llvm::raw_ostream &os;
+    OutputCompression compression;
+    Stats *stats;
+    uint64_t offset = 0;
+    std::vector<std::pair<std::string, uint64_t>> index;
+    llvm::SmallVector<uint8_t, 0> packed;
+    bool finished = false;
+
+public:
+    FramedWriter(llvm::raw_ostream &os, OutputCompression compression,
+                 Stats *stats = nullptr);
+    ~FramedWriter() { finish(); }
+
+    void addFrame(llvm::StringRef name, llvm::StringRef data);
+    // writes the index and trailer; nothing may be added afterwards
+    void finish();
+};
+
+struct FrameInfo {
+    std::string name;
+    uint64_t offset;
+};
+
+bool isFramed(llvm::StringRef file);
+// null and an error on stderr if the trailer or index is damaged
+std::optional<std::vector<FrameInfo>> readFrameIndex(llvm::StringRef file);
+// appends the decompressed frame at `offset` to `out`
+bool readFrame(llvm::StringRef file, uint64_t offset, std::string &out);
+
+// null if LLVM was built with the library behind `compression`, otherwise
+// the reason it can't be used
+const char *compressionUnsupportedReason(OutputCompression compression);
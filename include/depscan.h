@@ -0,0 +1,43 @@
+#pragma once
+
+// Every file a translation unit reads, as found by clang's dependency
+// scanner, with the size and mtime each had when it was scanned. The TU's
+// closure is still valid while its compile command and all of these match.
+struct IncludeClosure {
+    struct File {
+        std::string path;
+        int64_t mtime = 0;
+        uint64_t size = 0;
+    };
+
+    uint64_t command = 0;
+    std::vector<File> files;
+    // hash of the command and every file stamp; changes whenever the TU
+    // would need reprocessing
+    uint64_t key = 0;
+};
+
+// Include closures for a whole compilation database, persisted between runs
+// so that only TUs whose command or inputs changed are scanned again.
+class DependencyCache {
+    std::map<std::string, IncludeClosure> closures;
+
+public:
+    void load(const std::string &path);
+    void save(const std::string &path) const;
+
+    // rescans, in parallel, every source whose cached closure is missing or
+    // stale, using the directive-only lexer instead of a full parse
+    void update(const clang::tooling::CompilationDatabase &compilations,
+                const std::vector<std::string> &sources, unsigned jobs,
+                Stats &stats);
+
+    // the sources whose closure contains one of `changed`, plus any that
+    // could not be scanned
+    std::vector<std::string>
+    affectedBy(const std::vector<std::string> &changed,
+               const std::vector<std::string> &sources) const;
+
+    // null if `source` has no up-to-date closure
+    const IncludeClosure *find(const std::string &source) const;
+};
@@ -0,0 +1,31 @@
+#pragma once
+
+// Set of half-open [begin, end) offset ranges, merged on insert. Used to emit
+// each source range of a file at most once.
+class IntervalSet {
+    std::map<unsigned, unsigned> intervals; // begin => end, disjoint
+
+public:
+    bool contains(unsigned begin, unsigned end) const {
+        auto it = intervals.upper_bound(begin);
+        if (it == intervals.begin())
+            return false;
+        --it;
+        return end <= it->second;
+    }
+
+    void insert(unsigned begin, unsigned end) {
+        auto it = intervals.upper_bound(begin);
+        if (it != intervals.begin() && std::prev(it)->second >= begin) {
+            --it;
+            begin = it->first;
+            end = std::max(end, it->second);
+            it = intervals.erase(it);
+        }
+        while (it != intervals.end() && it->first <= end) {
+            end = std::max(end, it->second);
+            it = intervals.erase(it);
+        }
+        intervals.emplace(begin, end);
+    }
+};
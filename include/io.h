@@ -0,0 +1,153 @@
+#pragma once
+
+// Adds the microseconds spent in a scope to one of the *BlockedUs counters.
+class BlockedTimer {
+    Stats &stats;
+    Stats::Counter counter;
+    std::chrono::steady_clock::time_point start;
+
+public:
+    BlockedTimer(Stats &stats, Stats::Counter counter)
+        : stats(stats), counter(counter),
+          start(std::chrono::steady_clock::now()) {}
+    ~BlockedTimer() {
+        stats.add(counter,
+                  std::chrono::duration_cast<std::chrono::microseconds>(
+                      std::chrono::steady_clock::now() - start)
+                      .count());
+    }
+};
+
+// Passes everything through to the underlying file system, adding the time
+// spent in status() and in reading file contents to Stats::ReadBlockedUs and
+// counting the calls that reach the disk. Sits directly above the real file
+// system under every ClangTool.
+class TimedFileSystem : public llvm::vfs::ProxyFileSystem {
+    Stats &stats;
+
+public:
+    TimedFileSystem(llvm::IntrusiveRefCntPtr<llvm::vfs::FileSystem> fs,
+                    Stats &stats);
+
+    llvm::ErrorOr<llvm::vfs::Status> status(const llvm::Twine &path) override;
+    llvm::ErrorOr<std::unique_ptr<llvm::vfs::File>>
+    openFileForRead(const llvm::Twine &path) override;
+    llvm::vfs::directory_iterator dir_begin(const llvm::Twine &dir,
+                                            std::error_code &ec) override;
+};
+
+// Run-wide cache of stat results (misses included, which is most of what
+// header search produces), directory listings and file contents, shared by
+// every ClangTool and worker thread. Only absolute paths are cached, since
+// relative ones depend on each tool's working directory. Contents are
+// immutable once read; files we rewrite are dropped with invalidate() and
+// their old buffers kept alive for any TU still using them.
+class CachingFileSystem : public llvm::vfs::ProxyFileSystem {
+    using Listing = std::vector<llvm::vfs::directory_entry>;
+
+    Stats &stats;
+    mutable std::shared_mutex mutex;
+    llvm::StringMap<llvm::ErrorOr<llvm::vfs::Status>> statuses;
+    llvm::StringMap<std::shared_ptr<const llvm::MemoryBuffer>> contents;
+    llvm::StringMap<std::shared_ptr<const Listing>> listings;
+    std::vector<std::shared_ptr<const llvm::MemoryBuffer>> retired;
+
+public:
+    CachingFileSystem(llvm::IntrusiveRefCntPtr<llvm::vfs::FileSystem> fs,
+                      Stats &stats);
+
+    llvm::ErrorOr<llvm::vfs::Status> status(const llvm::Twine &path) override;
+    llvm::ErrorOr<std::unique_ptr<llvm::vfs::File>>
+    openFileForRead(const llvm::Twine &path) override;
+    llvm::vfs::directory_iterator dir_begin(const llvm::Twine &dir,
+                                            std::error_code &ec) override;
+
+    // forget `path`, after it has been written
+    void invalidate(llvm::StringRef path);
+};
+
+// One ClangTool's view of a file system shared with other tools, such as
+// the CachingFileSystem. ClangTool::run changes the working directory to
+// each compile command's; here that only changes this proxy's copy, and
+// every path is made absolute against it before it is passed down, so the
+// shared file system never sees a relative path or a directory change.
+class WorkingDirectoryFileSystem : public llvm::vfs::ProxyFileSystem {
+    std::string workingDirectory;
+
+    llvm::SmallString<256> absolute(const llvm::Twine &path) const;
+
+public:
+    // starts in the process's current directory
+    explicit WorkingDirectoryFileSystem(
+        llvm::IntrusiveRefCntPtr<llvm::vfs::FileSystem> fs);
+
+    llvm::ErrorOr<llvm::vfs::Status> status(const llvm::Twine &path) override;
+    bool exists(const llvm::Twine &path) override;
+    llvm::ErrorOr<std::unique_ptr<llvm::vfs::File>>
+    openFileForRead(const llvm::Twine &path) override;
+    llvm::vfs::directory_iterator dir_begin(const llvm::Twine &dir,
+                                            std::error_code &ec) override;
+    std::error_code getRealPath(const llvm::Twine &path,
+                                llvm::SmallVectorImpl<char> &output) override;
+    std::error_code isLocal(const llvm::Twine &path, bool &result) override;
+
+    llvm::ErrorOr<std::string> getCurrentWorkingDirectory() const override;
+    std::error_code
+    setCurrentWorkingDirectory(const llvm::Twine &path) override;
+};
+
+// Pulls the include closures of upcoming TUs into the page cache on a
+// background thread, staying at most `depth` TUs ahead of the parser.
+// Each file is prefetched once per run.
+class Prefetcher {
+    std::vector<std::vector<std::string>> closures;
+    unsigned depth;
+    Stats &stats;
+
+    std::mutex mutex;
+    std::condition_variable wake;
+    size_t started = 0;
+    bool stopping = false;
+    std::thread thread;
+
+    void run();
+
+public:
+    // `closures[i]` is the files TU i reads, in the order TUs will start
+    Prefetcher(std::vector<std::vector<std::string>> closures, unsigned depth,
+               Stats &stats);
+    ~Prefetcher();
+
+    // called as each TU starts parsing
+    void notifyStarted();
+};
+
+// Writes output files on a background thread. Callers hand over the content
+// and carry on; everything queued while a batch is being written goes out
+// as the next batch. wait() blocks until the queue is empty.
+class AsyncWriter {
+    Stats &stats;
+    CachingFileSystem *cache;
+
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable drained;
+    std::vector<std::pair<std::string, std::string>> queue;
+    bool writing = false;
+    bool stopping = false;
+    std::thread thread;
+
+    void run();
+
+public:
+    AsyncWriter(Stats &stats, CachingFileSystem *cache = nullptr);
+    ~AsyncWriter();
+
+    void write(std::string path, std::string content);
+    void wait();
+};
+
+// replaces `path` with `content` through a temporary file, reporting
+// failures on stderr, and drops any copy `cache` holds
+bool writeFile(llvm::StringRef path, llvm::StringRef content,
+               CachingFileSystem *cache = nullptr);
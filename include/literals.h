@@ -0,0 +1,9 @@
+#pragma once
+
+// Shortest spellings for numeric literals. Each function returns a spelling
+// whose type and value are identical to the literal's, or an empty string if
+// it can't prove one exists; callers compare its length with the original.
+std::string shortestIntegerSpelling(const clang::IntegerLiteral *literal,
+                                    const clang::ASTContext &ctx);
+std::string shortestFloatingSpelling(const clang::FloatingLiteral *literal,
+                                     const clang::ASTContext &ctx);
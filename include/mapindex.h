@@ -0,0 +1,60 @@
+#pragma once
+
+// Read-only two-way index over a mapping (short name <-> mapping key), laid
+// out so it can be mmap'd and queried in place without parsing anything:
+//
+//   header   "TSMI" u32 version, u32 count, u32 tableSize, u32 maxShortSize,
+//            u64 poolSize, u32 nameEnd (version 2 on)
+//   entries  count x { u32 keyOffset, u32 keySize,
+//                      u32 shortOffset, u32 shortSize }
+//   byShort  tableSize x u32, entry index + 1 (0 is empty)
+//   byKey    tableSize x u32, likewise
+//   pool     poolSize bytes of name text
+//
+// Integers are little-endian. Both tables are open-addressed on xxh3 with
+// linear probing and at most half full. nameEnd is the Renamer's next index
+// when the index was written, so a mapping layered on top can allocate past
+// it; version 1 files read as 0.
+class MappingIndex {
+    std::unique_ptr<llvm::MemoryBuffer> buffer;
+    uint32_t count = 0;
+    uint32_t tableSize = 0;
+    uint32_t maxShort = 0;
+    uint32_t end = 0;
+    const char *entries = nullptr;
+    const char *byShort = nullptr;
+    const char *byKey = nullptr;
+    llvm::StringRef pool;
+
+    MappingIndex() = default;
+    llvm::StringRef poolString(uint32_t offset, uint32_t size) const;
+    llvm::StringRef find(const char *table, llvm::StringRef name,
+                         bool byShortName) const;
+
+public:
+    // writes an index for `mappings` to `path`, atomically
+    static bool write(const std::unordered_map<std::string, std::string> &map,
+                      const std::string &path, uint32_t nameEnd = 0);
+    // null and an error on stderr if the file is missing or malformed
+    static std::unique_ptr<MappingIndex> open(const std::string &path);
+
+    // the mapping key a short name was assigned to, or empty
+    llvm::StringRef original(llvm::StringRef shortName) const;
+    // the short name assigned to a mapping key, or empty
+    llvm::StringRef shortName(llvm::StringRef key) const;
+
+    size_t size() const { return count; }
+    // no token longer than this can be a short name
+    unsigned maxShortSize() const { return maxShort; }
+    // every name this mapping assigned came from an index below this
+    unsigned nameEnd() const { return end; }
+};
+
+// Copies `input` to `out` with every identifier that is a short name in
+// `index` replaced by the name it stands for (macros without their '#').
+// Short names are also ordinary words, so unless `allWords` is set only
+// identifiers in a symbol context are replaced: quoted as 'name', called as
+// name(, or next to a `::`. Numbers are never looked into. Returns the
+// number of replacements.
+uint64_t unmapText(const MappingIndex &index, llvm::StringRef input,
+                   llvm::raw_ostream &out, bool allWords = false);
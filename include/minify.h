@@ -0,0 +1,13 @@
+#pragma once
+
+// Drops comments and collapses whitespace to the minimum needed to keep
+// tokens apart, in a single raw-lexer pass with no re-parse. Preprocessor
+// directives stay on their own lines and keep single spaces where the input
+// had whitespace, so function-like macro definitions keep their meaning.
+// Takes a std::string because the raw lexer relies on the trailing NUL.
+std::string stripWhitespace(const std::string &code,
+                            const clang::LangOptions &langOpts);
+
+// C++20 language options for stripping text that no CompilerInstance
+// produced, such as amalgamated output
+clang::LangOptions cxxLangOptions();
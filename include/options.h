@@ -0,0 +1,99 @@
+#pragma once
+
+// How Renamer orders the names of a given length. Sequential hands them out
+// a, b, ..., z, ba, ...; Cooccurrence draws on a frequency-ordered alphabet
+// and gives each top-level declaration its own run of same-prefix names.
+// The set of names of each length is the same either way, so the raw output
+// size barely moves; what changes is how well it compresses.
+enum class NamingStrategy { Sequential, Cooccurrence };
+
+class OutputPipeline;
+
+// Settings for a single tinysea run, threaded from main through the action
+// factories into every frontend action.
+struct ToolOptions {
+    // Keep rewritten buffers in the Renamer instead of overwriting the
+    // original files on disk.
+    bool inMemoryOutput = false;
+
+    // drop comments and redundant whitespace from everything we emit
+    bool stripWhitespace = false;
+
+    // respell integer, floating and bool literals in their shortest form
+    bool minifyLiterals = false;
+
+    // drop declarations unreachable from main, exported symbols and
+    // keepSymbols from the combined output, listing them in deadCodeReport
+    bool deadCodeElimination = false;
+    std::vector<std::string> keepSymbols;
+    std::string deadCodeReport;
+
+    // write --output as one self-contained translation unit with project
+    // headers inlined; sources are left untouched
+    bool amalgamate = false;
+
+    // also rename what project headers declare; a header is shared by
+    // several TUs, so it is handed to the Renamer and written once the run
+    // is over (or spliced into the amalgamation)
+    bool rewriteHeaders = false;
+
+    // with amalgamate, split the output into this many translation units
+    // balanced by parse time (0 = one file); internal-linkage names defined
+    // in a main file are then named per file, so chunks can't collide
+    unsigned unityChunks = 0;
+
+    // compress --output and the mapping file into independently
+    // decompressible frames
+    OutputCompression compression = OutputCompression::None;
+
+    // keep the original and rewritten text of every touched file so the
+    // output can be syntax-checked in memory after the run
+    bool verify = false;
+
+    // only process the TUs whose include closure contains one of these,
+    // using (and refreshing) the closures cached in depsCache;
+    // listAffected prints that selection instead of processing it
+    std::vector<std::string> changedFiles;
+    std::string depsCache;
+    bool listAffected = false;
+
+    // read the include closures of up to `prefetch` upcoming TUs into the
+    // page cache ahead of the parser (0 = off), and hand rewritten files to
+    // a background writer instead of writing them inline
+    unsigned prefetch = 0;
+    bool asyncWrites = false;
+
+    // share one stat, directory and file content cache between every TU
+    bool sharedFileCache = false;
+
+    // the services behind prefetch, asyncWrites and sharedFileCache for the
+    // current run, shared by every frontend action; null when off
+    Prefetcher *prefetcher = nullptr;
+    AsyncWriter *writer = nullptr;
+    CachingFileSystem *fileCache = nullptr;
+
+    // when non-zero, frontend actions only flatten their rewrites and queue
+    // them; serializeJobs threads strip and collect them and one thread
+    // writes them, with at most pipelineDepth items queued per stage
+    unsigned pipelineDepth = 0;
+    unsigned serializeJobs = 1;
+    OutputPipeline *pipeline = nullptr;
+
+    // keep short names clear of every identifier spelled in a system header
+    // or in a header outside projectRoot
+    bool guardExternalNames = true;
+    // normalized, with a trailing '/'; empty when there is no project, and
+    // then only system headers count as external
+    std::string projectRoot;
+
+    // only process this shard's slice of the compilation database, naming
+    // everything with placeholders for merge-mappings to replace
+    std::optional<ShardSpec> shard;
+
+    // number of translation units processed concurrently
+    unsigned jobs = 1;
+
+    // when non-zero, worker threads join the --time-trace profile with this
+    // granularity in microseconds
+    unsigned timeTraceGranularity = 0;
+};
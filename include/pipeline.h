@@ -0,0 +1,133 @@
+#pragma once
+
+// Fixed-capacity multi-producer, multi-consumer queue between two pipeline
+// stages. push() blocks while the queue is full, which is what bounds the
+// memory held by work in flight. Occupancy is tracked for --stats.
+template <typename T> class BoundedQueue {
+    std::mutex mutex;
+    std::condition_variable notFull;
+    std::condition_variable notEmpty;
+    std::deque<T> items;
+    size_t capacity;
+    bool closed = false;
+
+    uint64_t pushes = 0;
+    uint64_t depthSum = 0;
+    size_t maxDepth = 0;
+    double pushBlockedMs = 0;
+    double popBlockedMs = 0;
+
+    static double msSince(std::chrono::steady_clock::time_point start) {
+        return std::chrono::duration<double, std::milli>(
+                   std::chrono::steady_clock::now() - start)
+            .count();
+    }
+
+public:
+    explicit BoundedQueue(size_t capacity)
+        : capacity(std::max<size_t>(capacity, 1)) {}
+
+    void push(T item) {
+        auto start = std::chrono::steady_clock::now();
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            notFull.wait(lock, [&] { return items.size() < capacity; });
+            pushBlockedMs += msSince(start);
+            items.push_back(std::move(item));
+            ++pushes;
+            depthSum += items.size();
+            maxDepth = std::max(maxDepth, items.size());
+        }
+        notEmpty.notify_one();
+    }
+
+    // the next item, or nullopt once the queue is closed and empty
+    std::optional<T> pop() {
+        auto start = std::chrono::steady_clock::now();
+        std::optional<T> item;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            notEmpty.wait(lock, [&] { return closed || !items.empty(); });
+            popBlockedMs += msSince(start);
+            if (items.empty())
+                return std::nullopt;
+            item = std::move(items.front());
+            items.pop_front();
+        }
+        notFull.notify_one();
+        return item;
+    }
+
+    // wakes every consumer once the remaining items are gone
+    void close() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            closed = true;
+        }
+        notEmpty.notify_all();
+    }
+
+    // fills in the queue side of `stage`
+    void report(Stats::StageStats &stage) {
+        std::lock_guard<std::mutex> lock(mutex);
+        stage.capacity = capacity;
+        stage.items = pushes;
+        stage.meanDepth = pushes ? double(depthSum) / pushes : 0;
+        stage.maxDepth = maxDepth;
+        stage.producerBlockedMs = pushBlockedMs;
+        stage.idleMs = popBlockedMs;
+    }
+};
+
+// A file rewritten by one TU, as handed from the parse stage onwards.
+// `original` is only kept for --verify.
+struct RewrittenFile {
+    std::string path;
+    std::string content;
+    std::string original;
+    // a header, which other TUs still read as it was
+    bool header = false;
+};
+
+struct RewrittenTU {
+    std::vector<RewrittenFile> files;
+    clang::LangOptions langOpts;
+};
+
+// Finishes `file` the way the options ask: strips it, keeps the verify copy
+// and, for in-memory output or a header, hands it to the Renamer. Returns
+// true if the content still has to be written to `file.path`.
+bool serializeRewrittenFile(Renamer &renamer, const ToolOptions &options,
+                            const clang::LangOptions &langOpts,
+                            RewrittenFile &file);
+
+// Moves output off the parse workers. Frontend actions submit each TU's
+// rewritten text as soon as the traversal is done; `serializeJobs` threads
+// strip and collect it, and a single writer thread puts it on disk. Both
+// queues hold at most `depth` items, so parsing stalls instead of buffering
+// without limit when output falls behind.
+class OutputPipeline {
+    Renamer &renamer;
+    const ToolOptions &options;
+    BoundedQueue<RewrittenTU> serializeQueue;
+    BoundedQueue<RewrittenFile> writeQueue;
+    std::vector<std::thread> serializers;
+    std::thread writer;
+    std::atomic<uint64_t> serializeBusyUs = 0;
+    std::atomic<uint64_t> writeBusyUs = 0;
+    bool finished = false;
+
+    void serialize();
+    void write();
+
+public:
+    OutputPipeline(Renamer &renamer, const ToolOptions &options, size_t depth,
+                   unsigned serializeJobs);
+    ~OutputPipeline();
+
+    // blocks while the serialize stage is full
+    void submit(RewrittenTU tu);
+
+    // drains both stages and records their occupancy in the Renamer's Stats
+    void finish();
+};
@@ -0,0 +1,85 @@
+#pragma once
+
+// What a policy rule can test about a symbol besides its name.
+struct SymbolFacts {
+    enum Kind : unsigned {
+        Function = 1 << 0,
+        Method = 1 << 1,
+        Variable = 1 << 2,
+        Field = 1 << 3,
+        Parameter = 1 << 4,
+        Record = 1 << 5,
+        Enum = 1 << 6,
+        Enumerator = 1 << 7,
+        Typedef = 1 << 8,
+        Namespace = 1 << 9,
+        Other = 1 << 10,
+    };
+
+    std::string qualifiedName;
+    Kind kind = Other;
+    bool externC = false;
+    bool externallyVisible = false;
+    // [[clang::annotate("...")]] strings on the declaration
+    std::vector<std::string> annotations;
+
+    static SymbolFacts of(const clang::NamedDecl *decl);
+    // everything a verdict depends on, for caching it across TUs
+    std::string key() const;
+};
+
+// Decides which symbols keep their names. A policy file holds one rule per
+// line, `#` starting a comment:
+//
+//   keep|rename [kind=<kind>[,<kind>...]] [linkage=c|internal|external]
+//               [annotated=<text>] [namespace|name|glob|regex <pattern>]
+//
+// All parts of a rule must match; a rule without a name part matches any
+// name. A matching rename rule beats any keep rule. The built-in rules keep
+// namespace std, main, the fundamental type names and the free functions
+// the standard library finds by ADL (begin, end, swap, get).
+//
+// Rules sharing the same predicates are compiled together into one
+// namespace/name trie and one alternation regex (globs included), so a
+// lookup costs about the same however many rules there are.
+class NamePolicy {
+    struct Trie {
+        struct Node {
+            llvm::StringMap<unsigned> children;
+            bool exact = false;   // this name
+            bool subtree = false; // this name and everything inside it
+        };
+        std::vector<Node> nodes = std::vector<Node>(1);
+
+        void insert(llvm::StringRef name, bool subtree);
+        bool matches(llvm::StringRef name) const;
+    };
+
+    struct RuleGroup {
+        unsigned kinds = ~0u;
+        std::string linkage;
+        std::string annotation;
+        bool anyName = false;
+        Trie names;
+        std::vector<std::string> patterns;
+        std::optional<llvm::Regex> regex;
+
+        bool matches(const SymbolFacts &facts) const;
+    };
+
+    std::vector<RuleGroup> keepGroups;
+    std::vector<RuleGroup> renameGroups;
+    size_t rules = 0;
+
+    bool addRule(llvm::StringRef line, std::string &error);
+    bool compile(std::string &error);
+
+public:
+    static NamePolicy builtin();
+    // the built-in rules plus those in `path`; null and an error on stderr
+    // if the file can't be read or has a bad rule
+    static std::optional<NamePolicy> load(const std::string &path);
+
+    bool keeps(const SymbolFacts &facts) const;
+    size_t size() const { return rules; }
+};
@@ -0,0 +1,32 @@
+#pragma once
+
+// Cross-TU reference graph over declarations, keyed by qualified name so that
+// nodes from different translation units line up the same way the identifier
+// map does. Used to drop unreachable declarations from the combined output.
+class ReferenceGraph {
+    std::unordered_map<std::string, std::vector<std::string>> edges;
+    std::unordered_set<std::string> roots;
+
+public:
+    void addEdge(const std::string &from, const std::string &to);
+    void addRoot(const std::string &key);
+
+    // every key reachable from a root
+    std::unordered_set<std::string> reachable() const;
+};
+
+// --amalgamate builds its output from whole rewritten files rather than
+// sections, so with --dead-code-elim each top-level declaration is wrapped
+// in comment markers naming its graph node instead. Markers never contain
+// a line break, so the include lines amalgamate() splices stay valid.
+std::string sectionBeginMarker(const std::string &owner);
+extern const char sectionEndMarker[];
+
+// Removes the markers from `text`, blanking what they enclose when the node
+// is not in `live`. Line breaks and preprocessor directive lines survive
+// the blanking. Adds the blanked nodes to `dropped` and returns the bytes
+// removed, or nullopt if `text` has no markers.
+std::optional<size_t>
+removeDeadSections(std::string &text,
+                   const std::unordered_set<std::string> &live,
+                   std::set<std::string> &dropped);
@@ -1,24 +1,197 @@
 #pragma once
 
+// One per-declaration chunk of the combined --output file. `owner` is the
+// qualified name of the top-level declaration the text belongs to; sections
+// with an empty owner are never dropped.
+struct OutputSection {
+    std::string filename;
+    std::string owner;
+    std::string content;
+};
+
+// --gc-mappings: how the mapping file is trimmed after a full run.
+struct MappingGC {
+    // entries are kept for this many runs after the last one that used them
+    unsigned graceRuns = 0;
+    // at most this many entries get a shorter name per run
+    unsigned maxMoves = 64;
+};
+
 class Renamer {
     std::unordered_map<std::string, std::string> identifierMap;
+    // macro name (plus "@file" for a file's own) -> short name for this run;
+    // the entries double as interned ids, which is what the preprocessor
+    // callbacks cache per TU
+    llvm::StringMap<std::string> macroNames;
     std::set<std::string> reservedKeywords;
-    std::stringstream combinedOutput;
+    std::vector<OutputSection> sections;
+    ReferenceGraph references;
+    IncludeGraph includes;
+    std::map<std::string, std::string> rewrittenFiles;
+    std::map<std::string, BufferVersions> verifyBuffers;
+    std::vector<std::pair<std::string, std::string>> newMappings;
     unsigned currentIndex = 0;
+    NamingStrategy naming = NamingStrategy::Sequential;
+    // under --shard, prepended to every new name so that merge-mappings can
+    // tell each shard's names apart and replace them with the final ones
+    std::string placeholderPrefix;
+
+    // --naming=cooccurrence hands each context (top-level declaration) a
+    // block of names sharing everything but the last letter; what a context
+    // doesn't use goes back to freeIndices when it ends
+    struct NameBlock {
+        unsigned next = 0;
+        unsigned end = 0;
+    };
+    static constexpr unsigned blockSize = 8;
+    llvm::StringMap<NameBlock> contextBlocks;
+    std::set<unsigned> freeIndices;
+
+    // usage metadata, kept under --gc-mappings or once a loaded mapping
+    // carries it: the run each key was last used in and how often. Renames
+    // planned by a collection are saved and only applied by the next load,
+    // so a run's output always matches the mapping it saves.
+    struct Usage {
+        unsigned lastSeen = 0;
+        uint64_t uses = 0;
+    };
+    std::unordered_map<std::string, Usage> usage;
+    std::unordered_map<std::string, std::string> plannedMoves;
+    std::optional<MappingGC> gc;
+    bool trackUsage = false;
+    unsigned run = 1;
+    // indices below currentIndex that no entry holds, handed out first
+    std::set<unsigned> reclaimedIndices;
+
+    // --base-mapping: a read-only mapping shared by several projects,
+    // consulted in place after identifierMap and never copied into it. New
+    // names start at its nameEnd, and anything it assigned is unavailable.
+    std::unique_ptr<MappingIndex> baseMapping;
+    unsigned firstIndex = 0;
+
+    ExternalNames externalNames;
+    // identifiers spelled in project files that look like a short name,
+    // which a renamed declaration could shadow or a macro capture
+    llvm::StringSet<> projectSpellings;
+    NamePolicy policy = NamePolicy::builtin();
+    // policy verdicts for the whole run, by SymbolFacts::key
+    llvm::StringMap<bool> policyVerdicts;
+    // internally synchronized, so const output paths can count into it
+    mutable Stats stats;
+
+    // guards everything above so parallel workers can share one Renamer
+    mutable std::mutex mutex;
+
+    // the mapping file is mapped at load time but only parsed on first use, so
+    // runs that never look up a name don't pay for it
+    std::unique_ptr<llvm::MemoryBuffer> pendingMappings;
+    bool initialized = false;
 
-    std::string generateName(unsigned index);
     void initKeywords();
-    unsigned shortNameToIndex(const std::string &name);
+    void ensureInitialized();
+    void parseMappingFile(llvm::StringRef content);
+    void parseMetadata(const llvm::json::Object &meta,
+                       llvm::StringMap<std::string> &moves);
+    llvm::json::Object metadata() const;
+    void noteUse(const std::string &key);
+    Usage usageOf(const std::string &key) const;
+    unsigned indexOfEntry(llvm::StringRef key, llvm::StringRef shortName) const;
+    void reclaimIndices();
+    void planMoves();
+    bool isUnavailable(const std::string &name);
+    unsigned nextIndex();
+    unsigned blockIndex(llvm::StringRef context);
+    std::string nameForIndex(unsigned index) const;
+    unsigned indexForName(llvm::StringRef name) const;
+    std::string assignName(const std::string &key, const std::string &newName);
 
 public:
     Renamer();
+
+    static std::string generateName(unsigned index);
+    static unsigned shortNameToIndex(const std::string &name);
+    bool isReservedKeyword(const std::string &name);
+
+    // calls `entry` with each key and short name in a mapping file, plain
+    // or framed, and `metadata` with its metadata object if it has one;
+    // false (and an error on stderr) if it can't be read
+    static bool forEachMapping(
+        const std::string &filename,
+        llvm::function_ref<void(llvm::StringRef, llvm::StringRef)> entry,
+        llvm::function_ref<void(const llvm::json::Object &)> metadata = {});
+
     void loadMappings(const std::string &filename);
-    void saveMappings(const std::string &filename);
+    // writes a MappingIndex of everything loaded or assigned so far
+    bool writeMappingIndex(const std::string &path);
+    void saveMappings(const std::string &filename,
+                      OutputCompression compression = OutputCompression::None);
 
-    std::string getShortName(const std::string &qualifiedName);
+    void setNamingStrategy(NamingStrategy strategy);
+    // the strategy in effect, which a loaded mapping may have overridden
+    NamingStrategy getNamingStrategy();
+    void setPlaceholderPrefix(std::string prefix);
+    void setBaseMapping(std::unique_ptr<MappingIndex> base);
+    // must come before the first lookup, which is when mappings are parsed
+    void setGarbageCollection(MappingGC settings);
+    // drops the entries --gc-mappings no longer keeps and plans the renames
+    // the next load applies; call once a full run is done, before saving
+    void collectGarbage();
+    void setPolicy(NamePolicy newPolicy) { policy = std::move(newPolicy); }
+    // whether the policy keeps the symbol's name, evaluated once per run
+    // however many TUs declare or use it
+    bool keepsName(const SymbolFacts &facts);
 
-    bool hasMappings() const;
+    // `context` groups names that are likely to appear together; it only
+    // matters for NamingStrategy::Cooccurrence
+    std::string getShortName(const std::string &qualifiedName,
+                             llvm::StringRef context = "");
+    void endContext(llvm::StringRef context);
+    // macros live in their own "#NAME" keys of the mapping file, or
+    // "#NAME@file" for one named per `file`; the result stays valid for the
+    // lifetime of the Renamer
+    llvm::StringRef getMacroShortName(llvm::StringRef macroName,
+                                      llvm::StringRef file = "");
+
+    bool hasMappings();
+    Stats &getStats() { return stats; }
+    // filled by the preprocessor callbacks; short names avoid everything in it
+    ExternalNames &getExternalNames() { return externalNames; }
+    // records identifiers spelled in project files, so that no declaration
+    // or macro is given one of them as its short name
+    void addProjectSpellings(llvm::ArrayRef<llvm::StringRef> identifiers);
     void collectTransformedCode(const std::string &filename,
-                                const std::string &content);
+                                const std::string &content,
+                                const std::string &owner = "");
     std::string getCombinedOutput() const;
+    // streams the combined output section by section, as frames when
+    // compressing
+    void writeCombinedOutput(llvm::raw_ostream &os,
+                             OutputCompression compression) const;
+
+    void addReference(const std::string &from, const std::string &to);
+    void addRoot(const std::string &key);
+
+    void recordInclude(const std::string &includer,
+                       const IncludeDirective &directive);
+    void markIncludeGuarded(const std::string &path);
+    IncludeGraph getIncludeGraph() const;
+
+    // drop sections, and marked declarations in the rewritten files, whose
+    // owner isn't reachable from a root or from `keep`, listing what was
+    // dropped to `report` if given; returns bytes removed
+    size_t eliminateDeadCode(const std::vector<std::string> &keep,
+                             llvm::raw_ostream *report);
+
+    void collectRewrittenFile(const std::string &filename,
+                              const std::string &content);
+    const std::map<std::string, std::string> &getRewrittenFiles() const;
+
+    void collectVerifyBuffer(const std::string &path, BufferVersions buffer);
+    const std::map<std::string, BufferVersions> &getVerifyBuffers() const;
+
+    // drain the output collected so far, for callers that reuse one Renamer
+    // across many runs
+    std::map<std::string, std::string> takeRewrittenFiles();
+    std::string takeCombinedOutput();
+    std::vector<std::pair<std::string, std::string>> takeNewMappings();
 };
@@ -0,0 +1,35 @@
+#pragma once
+
+// One slice of a project split across processes with --shard=i/N. Sources
+// are assigned by a hash of their path below the sources' common
+// directory, so every machine computes the same split whatever its
+// checkout root.
+struct ShardSpec {
+    unsigned index = 0;
+    unsigned count = 0;
+
+    // "i/N" with i < N; nullopt and an error on stderr otherwise
+    static std::optional<ShardSpec> parse(llvm::StringRef text);
+
+    std::vector<std::string>
+    select(const std::vector<std::string> &sources) const;
+
+    // prefix of the placeholder names this shard writes; see
+    // Renamer::setPlaceholderPrefix
+    std::string placeholderPrefix() const;
+};
+
+// Copies `input` to `out` with every identifier that is a key of `names`
+// replaced by its value. Returns the number of replacements.
+uint64_t replacePlaceholders(const llvm::StringMap<std::string> &names,
+                             llvm::StringRef input, llvm::raw_ostream &out);
+
+// Combines the mapping files written by each shard. Every key any shard
+// named gets a final short name, taken from `base` if it has one and
+// otherwise assigned in sorted key order, so the result depends only on
+// the set of keys. The merged mapping is written to `output`, and the
+// placeholders in each of `rewrite` are replaced with the final names in
+// place, in parallel; no source is parsed again.
+int mergeMappings(const std::vector<std::string> &shardMappings,
+                  const std::string &base, const std::string &output,
+                  const std::vector<std::string> &rewrite, unsigned jobs);
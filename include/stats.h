@@ -0,0 +1,113 @@
+#pragma once
+
+// Run-wide counters and phase timings, written out by --stats. Counters are
+// atomic so visitors on different threads can bump them without locking.
+class Stats {
+public:
+    enum Counter {
+        DeclsVisited,
+        DeclarationsRewritten,
+        ReferencesRewritten,
+        MapHits,
+        MapMisses,
+        NewNames,
+        PreservedNames,
+        IntegerLiteralBytesSaved,
+        FloatingLiteralBytesSaved,
+        BoolLiteralBytesSaved,
+        SectionsEmitted,
+        SectionBytes,
+        NestedSectionsSkipped,
+        MacroNamesRewritten,
+        MacroParamsRewritten,
+        MacroBytesSaved,
+        CompressionInputBytes,
+        CompressionOutputBytes,
+        VerifiedFiles,
+        VerifyRegressions,
+        ClosuresScanned,
+        ClosuresCached,
+        FilesPrefetched,
+        AsyncWrites,
+        ReadBlockedUs,
+        WriteBlockedUs,
+        ExternalFilesScanned,
+        ExternalNamesSkipped,
+        PolicyEvaluations,
+        FsStatCalls,
+        FsOpenCalls,
+        FsDirListings,
+        StatCacheHits,
+        ContentCacheHits,
+        DirCacheHits,
+        MappingsDropped,
+        MappingsMoved,
+        BaseMapHits,
+        UnityChunkSources,
+        NumCounters
+    };
+
+    struct TUTimings {
+        std::string file;
+        double parseMs = 0;
+        double traverseMs = 0;
+        double rewriteMs = 0;
+    };
+
+    // one stage of the output pipeline: its input queue's occupancy, how
+    // long producers waited on it, and how its workers spent their time
+    struct StageStats {
+        std::string name;
+        unsigned workers = 0;
+        size_t capacity = 0;
+        uint64_t items = 0;
+        double meanDepth = 0;
+        size_t maxDepth = 0;
+        double producerBlockedMs = 0;
+        double busyMs = 0;
+        double idleMs = 0;
+    };
+
+    void add(Counter counter, uint64_t n = 1) {
+        counters[counter].fetch_add(n, std::memory_order_relaxed);
+    }
+    uint64_t get(Counter counter) const {
+        return counters[counter].load(std::memory_order_relaxed);
+    }
+
+    void addPhase(llvm::StringRef phase, double ms);
+    void addTU(TUTimings timings);
+    std::vector<TUTimings> getTUs() const;
+    void addStage(StageStats stage);
+
+    void writeJSON(llvm::raw_ostream &os) const;
+
+private:
+    std::array<std::atomic<uint64_t>, NumCounters> counters{};
+    mutable std::mutex mutex;
+    std::vector<std::pair<std::string, double>> phases;
+    std::vector<TUTimings> tus;
+    std::vector<StageStats> stages;
+};
+
+// Adds the time spent in a scope to `ms`, and records a matching event with
+// LLVM's time-trace profiler so --time-trace output lines up with clang's own
+// -ftime-trace events. The profiler half is a no-op unless it was initialized.
+class PhaseTimer {
+    llvm::TimeTraceScope scope;
+    std::chrono::steady_clock::time_point start;
+    double &ms;
+
+public:
+    PhaseTimer(llvm::StringRef name, double &out, llvm::StringRef detail = "")
+        : scope(name, detail), start(std::chrono::steady_clock::now()),
+          ms(out) {}
+    ~PhaseTimer() {
+        ms += std::chrono::duration<double, std::milli>(
+                  std::chrono::steady_clock::now() - start)
+                  .count();
+    }
+};
+
+// peak resident set size of this process in kilobytes, or 0 if unknown
+uint64_t getPeakRSSKB();
@@ -0,0 +1,64 @@
+#pragma once
+
+// Public in-process API for libtinysea. This header is self-contained so that
+// embedders don't need the clang headers that the rest of tinysea pulls in.
+
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+class Renamer;
+
+namespace tinysea {
+
+struct SourceBuffer {
+    std::string path;
+    std::string content;
+};
+
+struct RewriteRequest {
+    // translation units to rewrite
+    std::vector<SourceBuffer> sources;
+    // extra in-memory files (usually headers) the sources may include
+    std::vector<SourceBuffer> headers;
+    // compiler arguments applied to every source, e.g. {"-std=c++20"}
+    std::vector<std::string> args;
+    // directory that relative paths in args and sources are resolved against
+    std::string workingDirectory = ".";
+    // drop comments and redundant whitespace from the rewritten buffers
+    bool stripWhitespace = false;
+    // respell literals in their shortest equivalent form
+    bool minifyLiterals = false;
+};
+
+struct RewriteResult {
+    bool success = false;
+    // rewritten buffers, keyed by the path clang opened them with
+    std::vector<SourceBuffer> files;
+    // per-declaration text normally appended to the --output file
+    std::string combinedOutput;
+    // qualified name => short name pairs created by this call
+    std::vector<std::pair<std::string, std::string>> newMappings;
+    std::string diagnostics;
+};
+
+// A Session owns one identifier mapping and can rewrite any number of
+// requests against it without touching the disk. Sessions are not
+// thread-safe; use one per thread or serialize calls.
+class Session {
+    std::unique_ptr<Renamer> renamer;
+
+public:
+    Session();
+    ~Session();
+    Session(Session &&);
+    Session &operator=(Session &&);
+
+    void loadMappings(const std::string &filename);
+    void saveMappings(const std::string &filename);
+
+    RewriteResult rewrite(const RewriteRequest &request);
+};
+
+} // namespace tinysea
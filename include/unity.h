@@ -0,0 +1,22 @@
+#pragma once
+
+// One translation unit of --unity-chunks output: the main files it
+// amalgamates and their estimated parse cost in milliseconds.
+struct UnityChunk {
+    std::vector<std::string> sources;
+    double cost = 0;
+};
+
+// Splits `sources` into `count` chunks of similar parse cost. A source's
+// cost is its parse time in `tus` (the mean when it has none). Sources are
+// placed costliest first on the chunk that ends up cheapest with them in
+// it, where a chunk only pays for the part of a source's include closure
+// (weighted by bytes) it doesn't parse already. That keeps sources that
+// share headers together without letting one chunk run long.
+std::vector<UnityChunk>
+planUnityChunks(const std::vector<std::string> &sources,
+                const std::vector<Stats::TUTimings> &tus,
+                const IncludeGraph &graph, unsigned count);
+
+// the path of chunk `index` of `output`: out.cpp -> out.0.cpp
+std::string unityChunkPath(llvm::StringRef output, unsigned index);
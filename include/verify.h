@@ -0,0 +1,23 @@
+#pragma once
+
+// The contents of one file before and after tinysea touched it, kept in
+// memory for --verify.
+struct BufferVersions {
+    std::string original;
+    std::string rewritten;
+};
+
+// Runs -fsyntax-only over every file in `sources` with the rewritten buffers
+// mapped over the real files, on `jobs` threads, using the compile commands
+// from `compilations`. A file that fails is checked again against the
+// original buffers, and is reported on stderr only if the original compiled.
+// Nothing is written to disk and no compiler processes are started.
+// Returns the number of such regressions.
+unsigned verifyRewrites(const clang::tooling::CompilationDatabase &compilations,
+                        const std::vector<std::string> &sources,
+                        const std::map<std::string, BufferVersions> &buffers,
+                        unsigned jobs, Stats &stats);
+
+// The same check for a single buffer compiled with `args`, as in --stdin mode.
+bool verifyRewrite(const BufferVersions &buffer, const std::string &filename,
+                   const std::vector<std::string> &args, Stats &stats);
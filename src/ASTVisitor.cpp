@@ -1,79 +1,573 @@
 #include "stdafx.h"
 
-CustomASTVisitor::CustomASTVisitor(ASTContext &ctx, Renamer &r, Rewriter &rw)
-    : context(ctx), renamer(r), sm(ctx.getSourceManager()), rewriter(rw) {}
+#define DEBUG_TYPE "tinysea-visitor"
+
+// the outermost enclosing declaration that sits directly in a namespace or
+// the translation unit; out-of-line member definitions are their own owners
+static Decl *topLevelOwner(Decl *decl) {
+    if (isa_and_nonnull<TranslationUnitDecl>(decl))
+        return nullptr;
+    while (decl) {
+        DeclContext *parent = decl->getLexicalDeclContext();
+        if (!parent || parent->isFileContext() || isa<LinkageSpecDecl>(parent))
+            return decl;
+        decl = cast<Decl>(parent);
+    }
+    return nullptr;
+}
+
+// explicitly exported symbols are kept even if nothing here references them
+static bool isExternallyVisible(NamedDecl *decl) {
+    if (decl->hasAttr<DLLExportAttr>() || decl->hasAttr<UsedAttr>())
+        return true;
+    if (auto *visibility = decl->getAttr<VisibilityAttr>())
+        return visibility->getVisibility() == VisibilityAttr::Default;
+    if (auto *function = dyn_cast<FunctionDecl>(decl))
+        return function->isExternC();
+    if (auto *var = dyn_cast<VarDecl>(decl))
+        return var->isExternC();
+    return false;
+}
+
+// A namespace-scope or static member variable whose initializer or
+// destructor runs code is used by the program even if nothing names it, as
+// with registration objects.
+static bool hasDynamicInitialization(VarDecl *var, ASTContext &context) {
+    if (!var->hasGlobalStorage() || var->isStaticLocal() ||
+        var->getDeclContext()->isDependentContext() ||
+        var->isThisDeclarationADefinition() == VarDecl::DeclarationOnly ||
+        var->getType()->isIncompleteType())
+        return false;
+    if (var->needsDestruction(context))
+        return true;
+    const Expr *init = var->getInit();
+    if (!init || init->isValueDependent())
+        return false;
+    return !var->hasConstantInitialization() || init->HasSideEffects(context);
+}
+
+// graph node standing for every declaration spelled `name`, for dependent
+// uses whose target is only found at instantiation; '#' keeps it apart
+// from the qualified names
+static std::string nameNode(llvm::StringRef name) {
+    return "#" + name.str();
+}
+
+// the declaration a use is renamed under: templates by what they declare,
+// instantiations by the pattern they were instantiated from
+static NamedDecl *renamedDecl(NamedDecl *decl) {
+    if (auto *tmpl = dyn_cast<TemplateDecl>(decl))
+        if (NamedDecl *templated = tmpl->getTemplatedDecl())
+            decl = templated;
+    if (auto *function = dyn_cast<FunctionDecl>(decl)) {
+        if (FunctionDecl *pattern = function->getTemplateInstantiationPattern())
+            decl = pattern;
+    } else if (auto *var = dyn_cast<VarDecl>(decl)) {
+        if (VarDecl *pattern = var->getTemplateInstantiationPattern())
+            decl = pattern;
+    } else if (auto *record = dyn_cast<CXXRecordDecl>(decl)) {
+        if (const CXXRecordDecl *pattern =
+                record->getTemplateInstantiationPattern())
+            decl = const_cast<CXXRecordDecl *>(pattern);
+    }
+    return decl;
+}
+
+// names first seen inside the same top-level declaration are assigned
+// together under --naming=cooccurrence
+std::string CustomASTVisitor::namingContext() const {
+    if (naming != NamingStrategy::Cooccurrence)
+        return "";
+    return ownerKey(currentOwner);
+}
+
+// With --amalgamate, a main file's internal-linkage variables and
+// functions, and the types in its anonymous namespaces, are renamed per
+// file, so two TUs' helpers get different short names and can share the
+// output.
+bool CustomASTVisitor::isFileLocal(NamedDecl *decl) const {
+    if (!options.amalgamate)
+        return false;
+    if (isa<TagDecl, TypedefNameDecl>(decl)) {
+        if (!decl->isInAnonymousNamespace() ||
+            !decl->getDeclContext()->isFileContext())
+            return false;
+    } else if (!isa<VarDecl, FunctionDecl, EnumConstantDecl>(decl) ||
+               isa<CXXMethodDecl>(decl) ||
+               decl->getFormalLinkage() != Linkage::Internal) {
+        return false;
+    }
+    SourceLocation loc = decl->getCanonicalDecl()->getLocation();
+    return loc.isFileID() && sm.isWrittenInMainFile(loc);
+}
+
+// the mapping key a declaration is renamed under: its qualified name, plus
+// the main file for file-local ones
+std::string CustomASTVisitor::renameKey(NamedDecl *decl) const {
+    std::string key = decl->getQualifiedNameAsString();
+    if (!isFileLocal(decl))
+        return key;
+    OptionalFileEntryRef file = sm.getFileEntryRefForID(sm.getMainFileID());
+    return file ? key + "@" + normalizedPath(file->getName()) : key;
+}
+
+// reference graph node of a declaration, keyed like the mapping so that
+// file-local names from different TUs stay apart
+std::string CustomASTVisitor::ownerKey(Decl *decl) const {
+    if (auto *named = dyn_cast_or_null<NamedDecl>(decl))
+        return renameKey(named);
+    return "";
+}
+
+CustomASTVisitor::CustomASTVisitor(ASTContext &ctx, Renamer &r, Rewriter &rw,
+                                   const ToolOptions &opts)
+    : context(ctx), renamer(r), sm(ctx.getSourceManager()), rewriter(rw),
+      options(opts), naming(r.getNamingStrategy()) {}
 
 bool CustomASTVisitor::VisitNamedDecl(NamedDecl *decl) {
     if (!decl || processedDecls.count(decl))
         return true;
     processedDecls.insert(decl);
 
-    SourceManager &sm = decl->getASTContext().getSourceManager();
     SourceLocation loc = decl->getLocation();
 
     // Validate declaration location
-    if (loc.isInvalid() || !sm.isWrittenInMainFile(loc) ||
-        sm.isInSystemHeader(loc)) {
+    if (loc.isInvalid() || !isRewritable(sm.getFileID(loc)))
         return true;
-    }
 
-    // Generate short name
-    std::string qualifiedName = decl->getQualifiedNameAsString();
-    std::string shortName = renamer.getShortName(qualifiedName);
+    renamer.getStats().add(Stats::DeclsVisited);
 
-    // Collect changes
-    std::string transformed = rewriter.getRewrittenText(decl->getSourceRange());
-    renamer.collectTransformedCode(sm.getFilename(decl->getLocation()).str(),
-                                   transformed);
+    // the declaration is renamed along with its references
+    if (isRenamable(decl) && renameAt(loc, decl))
+        renamer.getStats().add(Stats::DeclarationsRewritten);
 
-    // Direct replacement in source file: don't want!
-    /*
-        if (decl->getIdentifier() && !decl->getName().empty()) {
-            SourceLocation nameLoc = sm.getSpellingLoc(decl->getLocation());
-            rewriter.ReplaceText(nameLoc, decl->getName().size(), shortName);
-            llvm::errs() << "Renamed: " << qualifiedName << " => " << shortName
-                         << "\n";
-        }
-    */
+    // a renamed class is spelled in its constructors' and destructor's
+    // names too
+    if (isa<CXXConstructorDecl, CXXDestructorDecl>(decl)) {
+        CXXRecordDecl *record = cast<CXXMethodDecl>(decl)->getParent();
+        if (isRenamable(record) &&
+            renameAt(nameLocAt(loc, record->getName()), record))
+            renamer.getStats().add(Stats::ReferencesRewritten);
+    }
+
+    if (options.deadCodeElimination)
+        recordDeclaration(decl, ownerKey(topLevelOwner(decl)));
+
+    // Collect changes. Nested declarations (fields, parameters, locals)
+    // fall inside a range that is already being emitted, so only the
+    // outermost one claims its range; its text is taken once its children
+    // have been rewritten, in TraverseDecl. Namespaces are containers, so
+    // their members get sections of their own. Headers are shared with
+    // other TUs and reach the output as whole files instead.
+    if (isa<NamespaceDecl>(decl) || !sm.isWrittenInMainFile(loc))
+        return true;
+    if (claimRange(decl->getSourceRange()))
+        pendingSections.insert(decl);
+    else
+        renamer.getStats().add(Stats::NestedSectionsSkipped);
 
     return true;
 }
 
 bool CustomASTVisitor::VisitDeclRefExpr(DeclRefExpr *expr) {
     if (NamedDecl *decl = expr->getDecl()) {
-        llvm::errs() << "Processing declaration reference expression: " << decl
-                     << "\n";
-        if (shouldSkip(decl))
-            return true;
+        recordReference(decl);
+        LLVM_DEBUG(llvm::dbgs()
+                   << "Processing declaration reference expression: " << decl
+                   << "\n");
+        if (isRenamable(decl) && renameAt(expr->getLocation(), decl))
+            renamer.getStats().add(Stats::ReferencesRewritten);
+    }
+    return true;
+}
 
-        std::string qualifiedName = decl->getQualifiedNameAsString();
-        std::string shortName = renamer.getShortName(qualifiedName);
-        llvm::errs() << "VisitDeclRefExpr, qualifiedName: " << qualifiedName
-                     << " shortName: " << shortName << "\n";
-        if (!shortName.empty()) {
-            rewriter.ReplaceText(expr->getLocation(), decl->getName().size(),
-                                 shortName);
-        }
+// `using ns::name;` spells the name of what it brings in
+bool CustomASTVisitor::VisitUsingDecl(UsingDecl *decl) {
+    for (UsingShadowDecl *shadow : decl->shadows()) {
+        NamedDecl *target = shadow->getTargetDecl();
+        if (!isRenamable(target))
+            continue;
+        if (renameAt(decl->getNameInfo().getLoc(), target))
+            renamer.getStats().add(Stats::ReferencesRewritten);
+        break;
     }
     return true;
 }
 
+bool CustomASTVisitor::VisitSizeOfPackExpr(SizeOfPackExpr *expr) {
+    NamedDecl *pack = expr->getPack();
+    if (pack && isRenamable(pack) && renameAt(expr->getPackLoc(), pack))
+        renamer.getStats().add(Stats::ReferencesRewritten);
+    return true;
+}
+
+// the names in a lambda's capture list; uses in its body are DeclRefExprs
+bool CustomASTVisitor::TraverseLambdaCapture(LambdaExpr *lambda,
+                                             const LambdaCapture *capture,
+                                             Expr *init) {
+    if (capture->capturesVariable() && !lambda->isInitCapture(capture)) {
+        NamedDecl *var = capture->getCapturedVar();
+        if (isRenamable(var) &&
+            renameAt(nameLocAt(capture->getLocation(), var->getName()), var))
+            renamer.getStats().add(Stats::ReferencesRewritten);
+    }
+    return RecursiveASTVisitor<CustomASTVisitor>::TraverseLambdaCapture(
+        lambda, capture, init);
+}
+
+bool CustomASTVisitor::VisitIntegerLiteral(IntegerLiteral *literal) {
+    if (options.minifyLiterals) {
+        replaceLiteral(literal->getLocation(),
+                       shortestIntegerSpelling(literal, context),
+                       Stats::IntegerLiteralBytesSaved);
+    }
+    return true;
+}
+
+bool CustomASTVisitor::VisitFloatingLiteral(FloatingLiteral *literal) {
+    if (options.minifyLiterals) {
+        replaceLiteral(literal->getLocation(),
+                       shortestFloatingSpelling(literal, context),
+                       Stats::FloatingLiteralBytesSaved);
+    }
+    return true;
+}
+
+// The literal under a user-defined one (1.0000h, 0x10s) is spelled with the
+// ud-suffix, which a respelling would drop, so it is marked as handled
+// before its children are visited.
+bool CustomASTVisitor::VisitUserDefinedLiteral(UserDefinedLiteral *literal) {
+    if (Expr *cooked = literal->getCookedLiteral())
+        processedLiterals.insert(cooked->getBeginLoc().getRawEncoding());
+    return true;
+}
+
+bool CustomASTVisitor::VisitImplicitCastExpr(ImplicitCastExpr *cast) {
+    if (!options.minifyLiterals)
+        return true;
+
+    // true/false only become 1/0 when they are immediately promoted to int,
+    // where the literal 1 has exactly the same type and value
+    auto *literal =
+        dyn_cast<CXXBoolLiteralExpr>(cast->getSubExpr()->IgnoreParens());
+    if (literal && cast->getCastKind() == CK_IntegralCast &&
+        context.hasSameType(cast->getType(), context.IntTy)) {
+        replaceLiteral(literal->getLocation(), literal->getValue() ? "1" : "0",
+                       Stats::BoolLiteralBytesSaved);
+    }
+    return true;
+}
+
+bool CustomASTVisitor::VisitMemberExpr(MemberExpr *expr) {
+    recordReference(expr->getMemberDecl());
+    return true;
+}
+
+bool CustomASTVisitor::VisitCXXConstructExpr(CXXConstructExpr *expr) {
+    if (CXXConstructorDecl *ctor = expr->getConstructor()) {
+        recordReference(ctor);
+        recordReference(ctor->getParent());
+    }
+    return true;
+}
+
+bool CustomASTVisitor::VisitTagTypeLoc(TagTypeLoc loc) {
+    TagDecl *decl = loc.getDecl();
+    recordReference(decl);
+    if (isRenamable(decl) && renameAt(loc.getNameLoc(), decl))
+        renamer.getStats().add(Stats::ReferencesRewritten);
+    return true;
+}
+
+bool CustomASTVisitor::VisitTypedefTypeLoc(TypedefTypeLoc loc) {
+    TypedefNameDecl *decl = loc.getTypedefNameDecl();
+    recordReference(decl);
+    if (isRenamable(decl) && renameAt(loc.getNameLoc(), decl))
+        renamer.getStats().add(Stats::ReferencesRewritten);
+    return true;
+}
+
+// a class template's name used inside its own definition
+bool CustomASTVisitor::VisitInjectedClassNameTypeLoc(
+    InjectedClassNameTypeLoc loc) {
+    CXXRecordDecl *decl = loc.getDecl();
+    if (isRenamable(decl) && renameAt(loc.getNameLoc(), decl))
+        renamer.getStats().add(Stats::ReferencesRewritten);
+    return true;
+}
+
+// a dependent call: the overloads ordinary lookup found at the template
+// definition, plus anything spelled the same if ADL may add more later
+bool CustomASTVisitor::VisitOverloadExpr(OverloadExpr *expr) {
+    for (NamedDecl *decl : expr->decls())
+        recordReference(decl->getUnderlyingDecl());
+    auto *lookup = dyn_cast<UnresolvedLookupExpr>(expr);
+    if (lookup && lookup->requiresADL())
+        recordNameUse(expr->getName());
+
+    // the call is renamed like the functions it can resolve to, as long as
+    // they all share one name
+    if (!lookup || expr->decls().empty())
+        return true;
+    NamedDecl *first = (*expr->decls_begin())->getUnderlyingDecl();
+    if (!isRenamable(first))
+        return true;
+    std::string key = renameKey(renamedDecl(first));
+    for (NamedDecl *decl : expr->decls()) {
+        NamedDecl *target = decl->getUnderlyingDecl();
+        if (!isRenamable(target) || renameKey(renamedDecl(target)) != key)
+            return true;
+    }
+    if (renameAt(expr->getNameLoc(), first))
+        renamer.getStats().add(Stats::ReferencesRewritten);
+    return true;
+}
+
+bool CustomASTVisitor::VisitCXXDependentScopeMemberExpr(
+    CXXDependentScopeMemberExpr *expr) {
+    recordNameUse(expr->getMember());
+    return true;
+}
+
+bool CustomASTVisitor::VisitDependentScopeDeclRefExpr(
+    DependentScopeDeclRefExpr *expr) {
+    recordNameUse(expr->getDeclName());
+    return true;
+}
+
+bool CustomASTVisitor::VisitTemplateSpecializationTypeLoc(
+    TemplateSpecializationTypeLoc loc) {
+    TemplateName name = loc.getTypePtr()->getTemplateName();
+    TemplateDecl *decl = name.getAsTemplateDecl();
+    recordReference(decl);
+    if (decl && isRenamable(decl) && renameAt(loc.getTemplateNameLoc(), decl))
+        renamer.getStats().add(Stats::ReferencesRewritten);
+    return true;
+}
+
+void CustomASTVisitor::recordNameUse(DeclarationName name) {
+    if (options.deadCodeElimination && currentOwner && name.isIdentifier())
+        renamer.addReference(ownerKey(currentOwner),
+                             nameNode(name.getAsIdentifierInfo()->getName()));
+}
+
+void CustomASTVisitor::recordReference(NamedDecl *target) {
+    if (!options.deadCodeElimination || !target || !currentOwner)
+        return;
+
+    std::string from = ownerKey(currentOwner);
+    std::string to = renameKey(target);
+    renamer.addReference(from, to);
+
+    // a member is only usable if its class is emitted too
+    std::string targetOwner = ownerKey(topLevelOwner(target));
+    if (!targetOwner.empty())
+        renamer.addReference(to, targetOwner);
+}
+
+void CustomASTVisitor::recordDeclaration(NamedDecl *decl,
+                                         const std::string &owner) {
+    std::string key = renameKey(decl);
+    auto *var = dyn_cast<VarDecl>(decl);
+    if (isa<NamespaceDecl>(decl) || isExternallyVisible(decl) ||
+        (var && hasDynamicInitialization(var, context)))
+        renamer.addRoot(key);
+
+    if (key != owner)
+        renamer.addReference(key, owner);
+    if (decl->getIdentifier())
+        renamer.addReference(nameNode(decl->getName()), key);
+
+    // out-of-line member definitions are their own owners; keep them
+    // whenever their class is kept, since virtual calls and implicit uses
+    // (constructors, destructors) don't show up as references
+    if (auto *method = dyn_cast<CXXMethodDecl>(decl)) {
+        std::string parent = renameKey(method->getParent());
+        renamer.addReference(parent, key);
+        renamer.addReference(key, parent);
+    }
+}
+
+void CustomASTVisitor::replaceLiteral(SourceLocation loc,
+                                      const std::string &spelling,
+                                      Stats::Counter bytesSaved) {
+    if (spelling.empty() || loc.isMacroID() || !sm.isWrittenInMainFile(loc))
+        return;
+    if (!processedLiterals.insert(loc.getRawEncoding()).second)
+        return;
+
+    llvm::StringRef original = tokenAt(loc);
+    if (spelling.size() >= original.size())
+        return;
+
+    renamer.getStats().add(bytesSaved, original.size() - spelling.size());
+    rewriter.ReplaceText(loc, original.size(), spelling);
+}
+
 bool CustomASTVisitor::TraverseDecl(Decl *D) {
     if (!D)
         return true;
 
-    SourceManager &sm = context.getSourceManager();
     SourceLocation loc = D->getLocation();
+    if (loc.isValid() && !isRewritable(sm.getFileID(loc)))
+        return true;
+
+    Decl *savedOwner = currentOwner;
+    bool isOwner = topLevelOwner(D) == D;
+    if (isOwner)
+        currentOwner = D;
+    bool result = RecursiveASTVisitor<CustomASTVisitor>::TraverseDecl(D);
+    if (isOwner && naming == NamingStrategy::Cooccurrence)
+        renamer.endContext(namingContext());
+    currentOwner = savedOwner;
+
+    if (pendingSections.erase(D))
+        emitSection(cast<NamedDecl>(D));
+    return result;
+}
+
+bool CustomASTVisitor::claimRange(SourceRange range) {
+    SourceLocation begin = sm.getExpansionLoc(range.getBegin());
+    SourceLocation end = sm.getExpansionLoc(range.getEnd());
+    if (begin.isInvalid() || end.isInvalid())
+        return true;
+
+    FileID file = sm.getFileID(begin);
+    if (file != sm.getFileID(end))
+        return true;
+
+    unsigned beginOffset = sm.getFileOffset(begin);
+    unsigned endOffset =
+        sm.getFileOffset(end) +
+        Lexer::MeasureTokenLength(end, sm, context.getLangOpts());
+
+    IntervalSet &emitted = emittedRanges[file];
+    if (emitted.contains(beginOffset, endOffset))
+        return false;
+    emitted.insert(beginOffset, endOffset);
+    return true;
+}
+
+void CustomASTVisitor::emitSection(NamedDecl *decl) {
+    std::string transformed = rewriter.getRewrittenText(decl->getSourceRange());
+    if (options.stripWhitespace)
+        transformed = stripWhitespace(transformed, context.getLangOpts());
+
+    renamer.getStats().add(Stats::SectionsEmitted);
+    renamer.getStats().add(Stats::SectionBytes, transformed.size());
+    std::string owner = ownerKey(topLevelOwner(decl));
+    renamer.collectTransformedCode(sm.getFilename(decl->getLocation()).str(),
+                                   transformed, owner);
+    if (options.amalgamate && options.deadCodeElimination)
+        markSection(decl->getSourceRange(), owner);
+}
+
+// wraps the section in markers in the rewritten file, which is what
+// --amalgamate takes its text from; see removeDeadSections
+void CustomASTVisitor::markSection(SourceRange range,
+                                   const std::string &owner) {
+    SourceLocation begin = sm.getExpansionLoc(range.getBegin());
+    SourceLocation end = sm.getExpansionLoc(range.getEnd());
+    if (owner.empty() || begin.isInvalid() || end.isInvalid() ||
+        sm.getFileID(begin) != sm.getFileID(end))
+        return;
+    rewriter.InsertTextBefore(begin, sectionBeginMarker(owner));
+    rewriter.InsertTextAfterToken(end, sectionEndMarker);
+}
 
-    if (loc.isValid() &&
-        (!sm.isWrittenInMainFile(loc) || sm.isInSystemHeader(loc))) {
+// asked once per symbol per TU, through isRenamable; the renamer keeps the
+// verdicts for the rest of the run
+bool CustomASTVisitor::isPreserved(NamedDecl *decl) {
+    if (!renamer.keepsName(SymbolFacts::of(decl)))
+        return false;
+    renamer.getStats().add(Stats::PreservedNames);
+    return true;
+}
+
+// the files whose text we rewrite: the main file and, with rewriteHeaders,
+// every header under the project root that isn't a system header
+bool CustomASTVisitor::isRewritable(FileID file) {
+    if (file == sm.getMainFileID())
         return true;
+    if (!options.rewriteHeaders || file.isInvalid())
+        return false;
+    auto [it, inserted] = rewritableFiles.try_emplace(file, false);
+    if (inserted) {
+        OptionalFileEntryRef entry = sm.getFileEntryRefForID(file);
+        it->second = entry &&
+                     !sm.isInSystemHeader(sm.getLocForStartOfFile(file)) &&
+                     isUnder(entry->getName(), options.projectRoot);
     }
+    return it->second;
+}
 
-    return RecursiveASTVisitor<CustomASTVisitor>::TraverseDecl(D);
+// Variables, functions and enumerators are renamed, declarations and
+// references alike, when all of their declarations are spelled in files we
+// rewrite. Members keep their names, as do extern "C" symbols, builtins and
+// main; types only get new names when they are file-local.
+bool CustomASTVisitor::isRenamable(NamedDecl *decl) {
+    decl = cast<NamedDecl>(renamedDecl(decl)->getCanonicalDecl());
+    auto [it, inserted] = renamableDecls.try_emplace(decl, false);
+    if (inserted) {
+        it->second =
+            hasRenamableKind(decl) &&
+            llvm::all_of(decl->redecls(), [&](const Decl *redecl) {
+                SourceLocation loc = redecl->getLocation();
+                return loc.isValid() && loc.isFileID() &&
+                       isRewritable(sm.getFileID(loc));
+            }) &&
+            !isPreserved(decl);
+    }
+    return it->second;
 }
 
-bool CustomASTVisitor::shouldSkip(NamedDecl *decl) {
-    SourceLocation loc = decl->getLocation();
-    return loc.isInvalid() || decl->isImplicit();
-}
\ No newline at end of file
+bool CustomASTVisitor::hasRenamableKind(NamedDecl *decl) const {
+    if (!decl->getIdentifier() || decl->isImplicit() ||
+        decl->getDeclContext()->isRecord())
+        return false;
+    if (isa<TagDecl, TypedefNameDecl>(decl))
+        return isFileLocal(decl);
+    if (auto *function = dyn_cast<FunctionDecl>(decl))
+        return !function->isMain() && !function->isExternC() &&
+               !function->getBuiltinID();
+    if (auto *var = dyn_cast<VarDecl>(decl))
+        return !var->isExternC();
+    return isa<EnumConstantDecl>(decl);
+}
+
+// Replaces `decl`'s name at `loc` with its short name. A use inside a macro
+// is renamed where it is spelled, once however often the macro expands; a
+// location outside the files we rewrite, or one that doesn't spell the name
+// (implicit code, ## pasting), is left alone.
+bool CustomASTVisitor::renameAt(SourceLocation loc, NamedDecl *decl) {
+    decl = renamedDecl(decl);
+    loc = sm.getSpellingLoc(loc);
+    if (loc.isInvalid() || !isRewritable(sm.getFileID(loc)) ||
+        tokenAt(loc) != decl->getName())
+        return false;
+    if (!renamedLocs.insert(loc.getRawEncoding()).second)
+        return false;
+
+    std::string shortName =
+        renamer.getShortName(renameKey(decl), namingContext());
+    LLVM_DEBUG(llvm::dbgs() << "renameAt: " << decl->getName() << " -> "
+                            << shortName << "\n");
+    return !shortName.empty() &&
+           !rewriter.ReplaceText(loc, decl->getName().size(), shortName);
+}
+
+llvm::StringRef CustomASTVisitor::tokenAt(SourceLocation loc) const {
+    return Lexer::getSourceText(CharSourceRange::getTokenRange(loc), sm,
+                                context.getLangOpts());
+}
+
+// `loc`, or the token after it when `loc` is on the punctuator in front of
+// a name: the & of a by-reference capture, the ~ of a destructor
+SourceLocation CustomASTVisitor::nameLocAt(SourceLocation loc,
+                                           llvm::StringRef name) const {
+    if (loc.isInvalid() || loc.isMacroID() || tokenAt(loc) == name)
+        return loc;
+    std::optional<Token> next =
+        Lexer::findNextToken(loc, sm, context.getLangOpts());
+    return next ? next->getLocation() : loc;
+}
@@ -3,109 +3,434 @@
 using namespace clang;
 using namespace clang::tooling;
 
+#define DEBUG_TYPE "tinysea-pp"
+
 CustomPPCallbacks::CustomPPCallbacks(Renamer &r, SourceManager &sm,
-                                     Rewriter &rw)
-    : renamer(r), sm(sm), rewriter(rw) {}
+                                     Rewriter &rw, const ToolOptions &opts,
+                                     Preprocessor &pp)
+    : renamer(r), sm(sm), rewriter(rw), options(opts), pp(pp) {}
+
+void CustomPPCallbacks::recordUse(const Token &nameTok) {
+    const IdentifierInfo *name = nameTok.getIdentifierInfo();
+    if (!name || nameTok.getLocation().isInvalid())
+        return;
+
+    // a macro passed as an argument to another macro is still spelled in the
+    // file; one that only appears through ## pasting is not, and can't be
+    // renamed
+    SourceLocation loc = sm.getSpellingLoc(nameTok.getLocation());
+    if (sm.isWrittenInMainFile(loc) && !sm.isInSystemHeader(loc)) {
+        macroUses.emplace_back(name, loc);
+    } else {
+        externalUses.insert(name);
+    }
+}
 
 void CustomPPCallbacks::MacroDefined(const Token &MacroNameTok,
                                      const MacroDirective *MD) {
+    const IdentifierInfo *name = MacroNameTok.getIdentifierInfo();
     SourceLocation loc = MacroNameTok.getLocation();
-    if (!sm.isInMainFile(loc) || sm.isInSystemHeader(loc)) {
+    if (!sm.isWrittenInMainFile(loc) || sm.isInSystemHeader(loc)) {
+        externalUses.insert(name);
         return;
     }
 
-    // check against a list of known identifiers
-    std::string macroName = MacroNameTok.getIdentifierInfo()->getName().str();
-    if (processedMacros.count(macroName)) {
-        return;
-    } // already processed
-    processedMacros.insert(macroName);
-
-    return; // don't bother with the rest of this method. we may want to delete
-            // the stuff below?
-
-    // now actually process the macro
-    bool isInvalid = loc.isInvalid();
-    bool isInMainFile = sm.isInMainFile(loc);
-    bool isInSystemHeader = sm.isInSystemHeader(loc);
-    std::string filename = sm.getFilename(loc).str();
-    std::string shortName = renamer.getShortName(macroName);
-
-    llvm::errs() << "MacroDefined: " << macroName
-                 << "\n shortName: " << shortName
-                 << "\n location: " << loc.printToString(sm)
-                 << "\n filename: " << filename << "\n isInvalid: " << isInvalid
-                 << "\n isInMainFile: " << isInMainFile
-                 << "\n isInSystemHeader: " << isInSystemHeader << "\n";
-
-    if (shortName.empty()) {
-        return;
-    }
-    // rewriter.ReplaceText(loc, macroName.length(), shortName);
+    definitions.emplace_back(name, MD->getMacroInfo());
+    projectMacros.try_emplace(name);
+    recordUse(MacroNameTok);
+}
+
+void CustomPPCallbacks::MacroUndefined(const Token &MacroNameTok,
+                                       const MacroDefinition &MD,
+                                       const MacroDirective *Undef) {
+    recordUse(MacroNameTok);
 }
 
 void CustomPPCallbacks::MacroExpands(const Token &MacroNameTok,
                                      const MacroDefinition &MD,
                                      SourceRange Range, const MacroArgs *Args) {
-    SourceLocation loc = MacroNameTok.getLocation();
-    if (!sm.isInMainFile(loc) || sm.isInSystemHeader(loc)) {
+    recordUse(MacroNameTok);
+}
+
+void CustomPPCallbacks::Defined(const Token &MacroNameTok,
+                                const MacroDefinition &MD, SourceRange Range) {
+    recordUse(MacroNameTok);
+}
+
+void CustomPPCallbacks::Ifdef(SourceLocation Loc, const Token &MacroNameTok,
+                              const MacroDefinition &MD) {
+    recordUse(MacroNameTok);
+}
+
+void CustomPPCallbacks::Ifndef(SourceLocation Loc, const Token &MacroNameTok,
+                               const MacroDefinition &MD) {
+    recordUse(MacroNameTok);
+}
+
+void CustomPPCallbacks::Elifdef(SourceLocation Loc, const Token &MacroNameTok,
+                                const MacroDefinition &MD) {
+    recordUse(MacroNameTok);
+}
+
+void CustomPPCallbacks::Elifndef(SourceLocation Loc, const Token &MacroNameTok,
+                                 const MacroDefinition &MD) {
+    recordUse(MacroNameTok);
+}
+
+bool CustomPPCallbacks::replaceName(SourceLocation loc, unsigned length,
+                                    llvm::StringRef newName) {
+    // the same spelling can be reported more than once, e.g. a macro argument
+    // that the outer macro's body uses twice
+    if (!rewrittenLocs.insert(loc.getRawEncoding()).second)
+        return false;
+    if (rewriter.ReplaceText(loc, length, newName))
+        return false;
+    renamer.getStats().add(Stats::MacroBytesSaved, length - newName.size());
+    return true;
+}
+
+void CustomPPCallbacks::renameMacros() {
+    // With --amalgamate every TU's macros end up in one file, where two
+    // sources defining BUF would clash, so they are named per file and
+    // renamed even when that doesn't make them shorter.
+    std::string file;
+    if (options.amalgamate) {
+        if (OptionalFileEntryRef main =
+                sm.getFileEntryRefForID(sm.getMainFileID()))
+            file = normalizedPath(main->getName());
+    }
+
+    // names are handed out in definition order so runs are reproducible
+    for (const auto &[name, info] : definitions) {
+        llvm::StringRef &shortName = projectMacros[name];
+        if (!shortName.empty() || externalUses.count(name))
+            continue;
+        // a macro name is at least two characters, see getMacroShortName
+        if (name->getLength() <= 2 && file.empty())
+            continue;
+        llvm::StringRef candidate =
+            renamer.getMacroShortName(name->getName(), file);
+        // a shard's placeholder stands in for a final name that will be
+        // short, so its own length doesn't matter
+        if (candidate.size() < name->getLength() || options.shard ||
+            !file.empty())
+            shortName = candidate;
+    }
+
+    for (const auto &[name, loc] : macroUses) {
+        auto it = projectMacros.find(name);
+        if (it == projectMacros.end() || it->second.empty())
+            continue;
+        if (replaceName(loc, name->getLength(), it->second)) {
+            renamer.getStats().add(Stats::MacroNamesRewritten);
+            LLVM_DEBUG(llvm::dbgs() << "macro " << name->getName() << " -> "
+                                    << it->second << " at "
+                                    << loc.printToString(sm) << "\n");
+        }
+    }
+
+    for (const auto &[name, info] : definitions) {
+        renameDefinition(*info);
+    }
+}
+
+void CustomPPCallbacks::renameDefinition(const MacroInfo &info) {
+    auto shortName = [&](const IdentifierInfo *id) -> llvm::StringRef {
+        auto it = projectMacros.find(id);
+        return it == projectMacros.end() ? llvm::StringRef() : it->second;
+    };
+
+    // parameters are local to the definition, so their new names only have
+    // to avoid whatever else the body spells and each other's old names
+    llvm::DenseMap<const IdentifierInfo *, std::string> params;
+    if (info.isFunctionLike()) {
+        std::set<std::string> taken;
+        for (const Token &tok : info.tokens()) {
+            const IdentifierInfo *id = tok.getIdentifierInfo();
+            if (!id || info.getParameterNum(id) >= 0)
+                continue;
+            taken.insert(id->getName().str());
+            taken.insert(shortName(id).str());
+        }
+        for (const IdentifierInfo *param : info.params())
+            taken.insert(param->getName().str());
+
+        unsigned next = 0;
+        for (const IdentifierInfo *param : info.params()) {
+            if (param->getName() == "__VA_ARGS__")
+                continue;
+            std::string newName;
+            do {
+                newName = Renamer::generateName(next++);
+            } while (taken.count(newName));
+            if (newName.size() < param->getLength())
+                params[param] = std::move(newName);
+        }
+    }
+
+    llvm::ArrayRef<Token> body = info.tokens();
+    for (size_t i = 0; i < body.size(); ++i) {
+        const Token &tok = body[i];
+        const IdentifierInfo *id = tok.getIdentifierInfo();
+        if (!id || !sm.isWrittenInMainFile(tok.getLocation()))
+            continue;
+        if (auto it = params.find(id); it != params.end()) {
+            if (replaceName(tok.getLocation(), id->getLength(), it->second))
+                renamer.getStats().add(Stats::MacroParamsRewritten);
+            continue;
+        }
+
+        // another project macro named in this body. Expanded ones were
+        // already reported, but a body that never expanded still has to
+        // agree with the new definition; pasted names are left alone since
+        // the paste result is what gets looked up
+        llvm::StringRef newName = shortName(id);
+        bool pasted = (i > 0 && body[i - 1].is(tok::hashhash)) ||
+                      (i + 1 < body.size() && body[i + 1].is(tok::hashhash));
+        if (!newName.empty() && !pasted &&
+            replaceName(tok.getLocation(), id->getLength(), newName))
+            renamer.getStats().add(Stats::MacroNamesRewritten);
+    }
+
+    if (params.empty())
         return;
+
+    // MacroInfo doesn't keep the parameter list tokens, so lex them again
+    // from the macro name onwards
+    auto [fileID, offset] = sm.getDecomposedLoc(info.getDefinitionLoc());
+    llvm::StringRef buffer = sm.getBufferData(fileID);
+    Lexer lexer(sm.getLocForStartOfFile(fileID), pp.getLangOpts(),
+                buffer.begin(), buffer.begin() + offset, buffer.end());
+    Token tok;
+    lexer.LexFromRawLexer(tok); // the macro name
+    while (!lexer.LexFromRawLexer(tok) && tok.isNot(tok::r_paren)) {
+        if (tok.isNot(tok::raw_identifier))
+            continue;
+        auto it = params.find(pp.getIdentifierInfo(tok.getRawIdentifier()));
+        if (it != params.end() &&
+            replaceName(tok.getLocation(), tok.getLength(), it->second))
+            renamer.getStats().add(Stats::MacroParamsRewritten);
     }
+}
+
+void CustomPPCallbacks::InclusionDirective(
+    SourceLocation HashLoc, const Token &IncludeTok, StringRef FileName,
+    bool IsAngled, CharSourceRange FilenameRange, OptionalFileEntryRef File,
+    StringRef SearchPath, StringRef RelativePath, const Module *SuggestedModule,
+    bool ModuleImported, SrcMgr::CharacteristicKind FileType) {
+    if (!options.amalgamate || !File || HashLoc.isMacroID())
+        return;
+
+    OptionalFileEntryRef includer =
+        sm.getFileEntryRefForID(sm.getFileID(HashLoc));
+    if (!includer)
+        return;
+
+    IncludeDirective directive;
+    directive.firstLine = sm.getSpellingLineNumber(HashLoc);
+    directive.lastLine =
+        sm.getSpellingLineNumber(FilenameRange.getEnd().getLocWithOffset(-1));
+    directive.target = normalizedPath(File->getName());
+    directive.isSystem = SrcMgr::isSystem(FileType);
+
+    renamer.recordInclude(normalizedPath(includer->getName()), directive);
+    includedFiles.push_back(*File);
+}
+
+// Every file is raw-lexed once per run as it is first entered, which is
+// before anything in this TU has been given a short name: system headers
+// and headers outside the project root for their identifiers, project files
+// for spellings a short name could clash with. With --cmake-project
+// most were already read from the dependency scan before any TU; this
+// catches the rest.
+void CustomPPCallbacks::FileChanged(SourceLocation Loc,
+                                    FileChangeReason Reason,
+                                    SrcMgr::CharacteristicKind FileType,
+                                    FileID PrevFID) {
+    if (Reason != EnterFile)
+        return;
 
-    bool isInvalid = loc.isInvalid();
-    bool isInMainFile = sm.isInMainFile(loc);
-    bool isInSystemHeader = sm.isInSystemHeader(loc);
-    std::string filename = sm.getFilename(loc).str();
-    std::string macroName = MacroNameTok.getIdentifierInfo()->getName().str();
-    std::string shortName = renamer.getShortName(macroName, true);
-
-    /*
-        llvm::errs() << "MacroExpands: " << macroName
-                     << "\n shortName: " << shortName
-                     << "\n location: " << loc.printToString(sm)
-                     << "\n filename: " << filename
-                     << "\n isInvalid: " << isInvalid
-                     << "\n isInMainFile: " << isInMainFile
-                     << "\n isInSystemHeader: " << isInSystemHeader
-                     << "\n"; */
-
-    if (shortName.empty()) {
-        std::cout << "empty shortname" << std::endl;
+    FileID file = sm.getFileID(Loc);
+    OptionalFileEntryRef entry = sm.getFileEntryRefForID(file);
+    if (!entry)
+        return;
+    std::string path = normalizedPath(entry->getName());
+    bool isExternal =
+        SrcMgr::isSystem(FileType) || !isUnder(path, options.projectRoot);
+    ExternalNames &external = renamer.getExternalNames();
+    if ((isExternal && !options.guardExternalNames) ||
+        !external.claimFile(path))
+        return;
+
+    std::optional<llvm::MemoryBufferRef> buffer = sm.getBufferOrNone(file);
+    if (!buffer)
+        return;
+    std::vector<llvm::StringRef> identifiers;
+    lexIdentifiers(buffer->getBuffer(), pp.getLangOpts(), identifiers);
+    if (!isExternal) {
+        renamer.addProjectSpellings(identifiers);
         return;
     }
+    external.insert(identifiers);
+    renamer.getStats().add(Stats::ExternalFilesScanned);
+}
 
-    rewriter.ReplaceText(loc, macroName.length(), shortName);
+void CustomPPCallbacks::EndOfMainFile() {
+    renameMacros();
+
+    // guard detection only finishes once a header has been fully lexed
+    for (FileEntryRef file : includedFiles) {
+        if (pp.getHeaderSearchInfo().isFileMultipleIncludeGuarded(file))
+            renamer.markIncludeGuarded(normalizedPath(file.getName()));
+    }
 }
 
 CustomASTConsumer::CustomASTConsumer(clang::ASTContext &ctx, Renamer &r,
-                                     clang::Rewriter &rw)
-    : visitor(std::make_unique<CustomASTVisitor>(ctx, r, rw)) {}
+                                     clang::Rewriter &rw,
+                                     const ToolOptions &opts,
+                                     double &traverseMs)
+    : visitor(std::make_unique<CustomASTVisitor>(ctx, r, rw, opts)),
+      traverseMs(traverseMs) {}
 
 void CustomASTConsumer::HandleTranslationUnit(clang::ASTContext &context) {
+    PhaseTimer timer("Traverse", traverseMs);
     visitor->TraverseDecl(context.getTranslationUnitDecl());
 }
 
-CustomFrontendAction::CustomFrontendAction(Renamer &r)
-    : renamer(r), rewriter(std::make_unique<Rewriter>()) {}
+CustomFrontendAction::CustomFrontendAction(Renamer &r,
+                                           const ToolOptions &opts)
+    : renamer(r), options(opts), rewriter(std::make_unique<Rewriter>()) {}
 
 std::unique_ptr<clang::ASTConsumer>
 CustomFrontendAction::CreateASTConsumer(clang::CompilerInstance &ci,
                                         llvm::StringRef) {
-    // rewriter->setSourceMgr(ci.getSourceManager(), ci.getLangOpts());
-    return std::make_unique<CustomASTConsumer>(ci.getASTContext(), renamer,
-                                               *rewriter);
+    rewriter->setSourceMgr(ci.getSourceManager(), ci.getLangOpts());
+    return std::make_unique<CustomASTConsumer>(
+        ci.getASTContext(), renamer, *rewriter, options, timings.traverseMs);
 }
 
 void CustomFrontendAction::ExecuteAction() {
     clang::CompilerInstance &ci = getCompilerInstance();
-    ci.getPreprocessor().addPPCallbacks(std::make_unique<CustomPPCallbacks>(
-        renamer, ci.getSourceManager(), *rewriter));
-    clang::ASTFrontendAction::ExecuteAction();
-    rewriter->overwriteChangedFiles();
+    SourceManager &sm = ci.getSourceManager();
+    FileID mainFile = sm.getMainFileID();
+    if (OptionalFileEntryRef entry = sm.getFileEntryRefForID(mainFile))
+        timings.file = entry->getName().str();
+
+    Preprocessor &pp = ci.getPreprocessor();
+    pp.addPPCallbacks(std::make_unique<CustomPPCallbacks>(
+        renamer, sm, *rewriter, options, pp));
+
+    // ParseAST runs the traversal from HandleTranslationUnit, so the parse
+    // time is whatever the traversal didn't account for
+    double actionMs = 0;
+    {
+        PhaseTimer timer("Parse", actionMs, timings.file);
+        clang::ASTFrontendAction::ExecuteAction();
+    }
+    timings.parseMs = actionMs - timings.traverseMs;
+
+    {
+        PhaseTimer timer("Rewrite", timings.rewriteMs, timings.file);
+        emitRewrittenBuffers();
+    }
+
+    renamer.getStats().addTU(std::move(timings));
+}
+
+void CustomFrontendAction::emitRewrittenBuffers() {
+    clang::CompilerInstance &ci = getCompilerInstance();
+    SourceManager &sm = ci.getSourceManager();
+
+    // without a background writer or headers to hold back, the Rewriter can
+    // write its own buffers
+    if (!options.inMemoryOutput && !options.stripWhitespace &&
+        !options.writer && !options.pipeline && !options.rewriteHeaders) {
+        if (options.verify) {
+            for (auto it = rewriter->buffer_begin();
+                 it != rewriter->buffer_end(); ++it) {
+                std::string content;
+                llvm::raw_string_ostream os(content);
+                it->second.write(os);
+                os.flush();
+                collectForVerify(it->first, std::move(content));
+            }
+        }
+        {
+            BlockedTimer timer(renamer.getStats(), Stats::WriteBlockedUs);
+            rewriter->overwriteChangedFiles();
+        }
+        if (options.fileCache) {
+            for (auto it = rewriter->buffer_begin();
+                 it != rewriter->buffer_end(); ++it) {
+                if (OptionalFileEntryRef entry =
+                        sm.getFileEntryRefForID(it->first))
+                    options.fileCache->invalidate(entry->getName());
+            }
+        }
+        return;
+    }
+
+    // the main file is always included so callers get output (and stripping)
+    // even when nothing in it was renamed
+    if (options.inMemoryOutput || options.stripWhitespace)
+        rewriter->getEditBuffer(sm.getMainFileID());
+
+    // the rewrites only live as long as this TU's SourceManager, so they
+    // are flattened here; everything after that can happen elsewhere
+    RewrittenTU tu;
+    for (auto it = rewriter->buffer_begin(); it != rewriter->buffer_end();
+         ++it) {
+        OptionalFileEntryRef entry = sm.getFileEntryRefForID(it->first);
+        if (!entry)
+            continue;
+        RewrittenFile file;
+        file.path = entry->getName().str();
+        file.header =
+            options.rewriteHeaders && it->first != sm.getMainFileID();
+        llvm::raw_string_ostream os(file.content);
+        it->second.write(os);
+        os.flush();
+        if (options.verify)
+            file.original = sm.getBufferData(it->first).str();
+        tu.files.push_back(std::move(file));
+    }
+
+    if (options.pipeline) {
+        tu.langOpts = ci.getLangOpts();
+        options.pipeline->submit(std::move(tu));
+        return;
+    }
+
+    for (RewrittenFile &file : tu.files) {
+        if (!serializeRewrittenFile(renamer, options, ci.getLangOpts(), file))
+            continue;
+        if (options.writer) {
+            options.writer->write(std::move(file.path),
+                                  std::move(file.content));
+            continue;
+        }
+        BlockedTimer timer(renamer.getStats(), Stats::WriteBlockedUs);
+        writeFile(file.path, file.content, options.fileCache);
+    }
+}
+
+// --verify needs both versions, and the original is about to be overwritten
+// on disk in the default mode, so it is taken from the SourceManager here
+void CustomFrontendAction::collectForVerify(FileID file, std::string content) {
+    SourceManager &sm = getCompilerInstance().getSourceManager();
+    OptionalFileEntryRef entry = sm.getFileEntryRefForID(file);
+    if (!entry)
+        return;
+    renamer.collectVerifyBuffer(normalizedPath(entry->getName()),
+                                {sm.getBufferData(file).str(),
+                                 std::move(content)});
 }
 
-CustomActionFactory::CustomActionFactory(Renamer &r) : renamer(r) {}
+CustomActionFactory::CustomActionFactory(Renamer &r, const ToolOptions &opts)
+    : renamer(r), options(opts) {}
 
 std::unique_ptr<FrontendAction> CustomActionFactory::create() {
-    return std::make_unique<CustomFrontendAction>(renamer);
+    if (options.prefetcher)
+        options.prefetcher->notifyStarted();
+    return std::make_unique<CustomFrontendAction>(renamer, options);
 }
@@ -0,0 +1,144 @@
+#include "stdafx.h"
+
+std::string normalizedPath(llvm::StringRef path) {
+    llvm::SmallString<256> result(path);
+    llvm::sys::fs::make_absolute(result);
+    llvm::sys::path::remove_dots(result, /*remove_dot_dot=*/true);
+    return result.str().str();
+}
+
+std::string commonDirectory(const std::vector<std::string> &paths) {
+    llvm::StringRef common = paths.empty() ? "" : paths.front();
+    for (llvm::StringRef path : paths) {
+        size_t n = 0;
+        while (n < common.size() && n < path.size() && common[n] == path[n])
+            ++n;
+        common = common.take_front(n);
+    }
+    size_t slash = common.rfind('/');
+    if (slash == llvm::StringRef::npos)
+        return "";
+    return common.take_front(slash + 1).str();
+}
+
+bool isUnder(llvm::StringRef path, llvm::StringRef root) {
+    return root.empty() || normalizedPath(path).starts_with(root);
+}
+
+namespace {
+
+class Amalgamator {
+    const IncludeGraph &graph;
+    const std::map<std::string, std::string> &rewritten;
+    std::set<std::string> inlined;
+    std::set<std::string> systemIncluded;
+    std::vector<std::string> stack;
+    std::string out;
+
+    bool loadText(const std::string &path, std::string &text) {
+        if (auto it = rewritten.find(path); it != rewritten.end()) {
+            text = it->second;
+            return true;
+        }
+        auto buffer = llvm::MemoryBuffer::getFile(path, /*IsText=*/true);
+        if (!buffer) {
+            llvm::errs() << "amalgamate: cannot read " << path << ": "
+                         << buffer.getError().message() << "\n";
+            return false;
+        }
+        text = (*buffer)->getBuffer().str();
+        return true;
+    }
+
+    bool isGuarded(const std::string &path) const {
+        auto it = graph.find(path);
+        return it != graph.end() && it->second.guarded;
+    }
+
+    void emitInclude(const IncludeDirective &directive,
+                     llvm::ArrayRef<llvm::StringRef> lines) {
+        const std::string &target = directive.target;
+
+        if (directive.isSystem) {
+            // a guarded system header only needs to be parsed once
+            if (isGuarded(target) && !systemIncluded.insert(target).second)
+                return;
+            for (llvm::StringRef line : lines) {
+                out += line;
+                out += '\n';
+            }
+            return;
+        }
+
+        if (llvm::is_contained(stack, target))
+            return;
+        if (isGuarded(target) && !inlined.insert(target).second)
+            return;
+        emitFile(target);
+    }
+
+    void emitFile(const std::string &path) {
+        std::string text;
+        if (!loadText(path, text))
+            return;
+
+        stack.push_back(path);
+        out += "// ======== " + path + " ========\n";
+
+        const IncludedFile *info = nullptr;
+        if (auto it = graph.find(path); it != graph.end())
+            info = &it->second;
+
+        llvm::SmallVector<llvm::StringRef, 0> lines;
+        llvm::StringRef(text).split(lines, '\n');
+        if (!lines.empty() && lines.back().empty())
+            lines.pop_back();
+
+        for (unsigned i = 0; i < lines.size(); ++i) {
+            unsigned lineNo = i + 1;
+            if (info) {
+                auto it = info->directives.find(lineNo);
+                if (it != info->directives.end()) {
+                    const IncludeDirective &directive = it->second;
+                    unsigned last = std::min<unsigned>(directive.lastLine,
+                                                       lines.size());
+                    emitInclude(directive, llvm::ArrayRef<llvm::StringRef>(
+                                               lines)
+                                               .slice(i, last - i));
+                    i = last - 1;
+                    continue;
+                }
+            }
+
+            llvm::StringRef trimmed = lines[i].trim();
+            if (trimmed.consume_front("#") &&
+                trimmed.ltrim().starts_with("pragma") &&
+                trimmed.ltrim().drop_front(6).trim() == "once")
+                continue;
+
+            out += lines[i];
+            out += '\n';
+        }
+
+        stack.pop_back();
+    }
+
+public:
+    Amalgamator(const IncludeGraph &graph,
+                const std::map<std::string, std::string> &rewritten)
+        : graph(graph), rewritten(rewritten) {}
+
+    std::string run(const std::vector<std::string> &mainFiles) {
+        for (const auto &file : mainFiles)
+            emitFile(normalizedPath(file));
+        return std::move(out);
+    }
+};
+
+} // namespace
+
+std::string amalgamate(const std::vector<std::string> &mainFiles,
+                       const IncludeGraph &graph,
+                       const std::map<std::string, std::string> &rewritten) {
+    return Amalgamator(graph, rewritten).run(mainFiles);
+}
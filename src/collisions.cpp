@@ -0,0 +1,126 @@
+#include "stdafx.h"
+
+using namespace clang;
+
+// double hashing: bit i of a name is h1 + i * h2, with h2 odd so the probes
+// don't repeat within one name
+static unsigned filterBit(uint64_t hash, unsigned i, unsigned bits) {
+    uint32_t h1 = hash;
+    uint32_t h2 = (hash >> 32) | 1;
+    return (h1 + i * h2) & (bits - 1);
+}
+
+static uint64_t hashName(llvm::StringRef name) {
+    return llvm::xxh3_64bits(llvm::arrayRefFromStringRef(name));
+}
+
+bool ExternalNames::mayContain(uint64_t hash) const {
+    for (unsigned i = 0; i < numHashes; ++i) {
+        unsigned bit = filterBit(hash, i, filterBits);
+        if (!(filter[bit / 64].load(std::memory_order_relaxed) &
+              (uint64_t(1) << (bit % 64))))
+            return false;
+    }
+    return true;
+}
+
+bool ExternalNames::claimFile(llvm::StringRef path) {
+    std::lock_guard<std::mutex> lock(mutex);
+    return scannedFiles.insert(path).second;
+}
+
+void ExternalNames::insert(llvm::ArrayRef<llvm::StringRef> identifiers) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!filter) {
+        filter = std::make_unique<std::atomic<uint64_t>[]>(filterBits / 64);
+        for (unsigned i = 0; i < filterBits / 64; ++i)
+            filter[i].store(0, std::memory_order_relaxed);
+    }
+
+    for (llvm::StringRef identifier : identifiers) {
+        if (!names.insert(identifier).second)
+            continue;
+        uint64_t hash = hashName(identifier);
+        for (unsigned i = 0; i < numHashes; ++i) {
+            unsigned bit = filterBit(hash, i, filterBits);
+            filter[bit / 64].fetch_or(uint64_t(1) << (bit % 64),
+                                      std::memory_order_relaxed);
+        }
+    }
+    // the filter is only read once this is seen, after its allocation
+    empty.store(names.empty(), std::memory_order_release);
+}
+
+bool ExternalNames::contains(llvm::StringRef identifier) const {
+    if (empty.load(std::memory_order_acquire))
+        return false;
+    if (!mayContain(hashName(identifier)))
+        return false;
+    std::lock_guard<std::mutex> lock(mutex);
+    return names.contains(identifier);
+}
+
+size_t ExternalNames::size() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return names.size();
+}
+
+std::vector<std::string> ExternalNames::sorted() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    std::vector<std::string> result;
+    result.reserve(names.size());
+    for (const auto &name : names)
+        result.push_back(name.getKey().str());
+    std::sort(result.begin(), result.end());
+    return result;
+}
+
+void lexIdentifiers(llvm::StringRef text, const LangOptions &langOpts,
+                    std::vector<llvm::StringRef> &out) {
+    const char *begin = text.data();
+    Lexer lexer(SourceLocation(), langOpts, begin, begin, begin + text.size());
+    Token tok;
+    while (true) {
+        lexer.LexFromRawLexer(tok);
+        if (tok.is(tok::eof))
+            break;
+        if (tok.is(tok::raw_identifier))
+            out.push_back(tok.getRawIdentifier());
+    }
+}
+
+void scanIncludeClosures(
+    const DependencyCache &cache, const std::vector<std::string> &sources,
+    const std::string &projectRoot, unsigned jobs, bool guardExternal,
+    ExternalNames &external,
+    llvm::function_ref<void(llvm::ArrayRef<llvm::StringRef>)> project,
+    Stats &stats) {
+    LangOptions langOpts = cxxLangOptions();
+    llvm::ThreadPool pool(llvm::hardware_concurrency(jobs));
+    for (const std::string &source : sources) {
+        const IncludeClosure *closure = cache.find(source);
+        if (!closure)
+            continue;
+        for (const IncludeClosure::File &file : closure->files) {
+            bool isExternal = !isUnder(file.path, projectRoot);
+            if ((isExternal && !guardExternal) ||
+                !external.claimFile(file.path))
+                continue;
+            pool.async([&, isExternal, path = file.path] {
+                auto buffer = llvm::MemoryBuffer::getFile(
+                    path, /*IsText=*/false, /*RequiresNullTerminator=*/false);
+                if (!buffer)
+                    return;
+                std::vector<llvm::StringRef> identifiers;
+                lexIdentifiers((*buffer)->getBuffer(), langOpts, identifiers);
+                if (!isExternal) {
+                    project(identifiers);
+                    return;
+                }
+                external.insert(identifiers);
+                stats.add(Stats::ExternalFilesScanned);
+            });
+        }
+    }
+    pool.wait();
+}
@@ -0,0 +1,195 @@
+#include "stdafx.h"
+
+using namespace llvm::support;
+
+static constexpr llvm::StringLiteral headerMagic = "TSEA";
+static constexpr llvm::StringLiteral trailerMagic = "AEST";
+static constexpr uint8_t frameVersion = 1;
+static constexpr size_t headerSize = 5;
+static constexpr size_t trailerSize = 12;
+
+enum FrameFormat : uint8_t { Stored = 0, Zlib = 1, Zstd = 2 };
+
+static llvm::compression::Format toLLVMFormat(OutputCompression compression) {
+    return compression == OutputCompression::Zstd
+               ? llvm::compression::Format::Zstd
+               : llvm::compression::Format::Zlib;
+}
+
+const char *compressionUnsupportedReason(OutputCompression compression) {
+    if (compression == OutputCompression::None)
+        return nullptr;
+    return llvm::compression::getReasonIfUnsupported(toLLVMFormat(compression));
+}
+
+FramedWriter::FramedWriter(llvm::raw_ostream &os,
+                           OutputCompression compression, Stats *stats)
+    : os(os), compression(compression), stats(stats) {
+    os << headerMagic;
+    os << static_cast<char>(frameVersion);
+    offset = headerSize;
+}
+
+void FramedWriter::addFrame(llvm::StringRef name, llvm::StringRef data) {
+    assert(!finished && "frame added after finish()");
+
+    uint8_t format = Stored;
+    llvm::StringRef payload = data;
+    if (compression != OutputCompression::None && !data.empty()) {
+        auto start = std::chrono::steady_clock::now();
+        packed.clear();
+        llvm::compression::compress(toLLVMFormat(compression),
+                                    llvm::arrayRefFromStringRef(data), packed);
+        if (stats) {
+            stats->addPhase("compress",
+                            std::chrono::duration<double, std::milli>(
+                                std::chrono::steady_clock::now() - start)
+                                .count());
+            stats->add(Stats::CompressionInputBytes, data.size());
+        }
+
+        if (packed.size() < data.size()) {
+            format = compression == OutputCompression::Zstd ? Zstd : Zlib;
+            payload = llvm::toStringRef(packed);
+        }
+    }
+
+    index.emplace_back(name.str(), offset);
+
+    endian::Writer writer(os, llvm::endianness::little);
+    writer.write<uint8_t>(format);
+    writer.write<uint32_t>(name.size());
+    os << name;
+    writer.write<uint64_t>(data.size());
+    writer.write<uint64_t>(payload.size());
+    os << payload;
+
+    offset += 1 + 4 + name.size() + 8 + 8 + payload.size();
+    if (stats)
+        stats->add(Stats::CompressionOutputBytes, payload.size());
+}
+
+void FramedWriter::finish() {
+    if (finished)
+        return;
+    finished = true;
+
+    endian::Writer writer(os, llvm::endianness::little);
+    uint64_t indexOffset = offset;
+    writer.write<uint32_t>(index.size());
+    for (const auto &[name, frameOffset] : index) {
+        writer.write<uint32_t>(name.size());
+        os << name;
+        writer.write<uint64_t>(frameOffset);
+    }
+    writer.write<uint64_t>(indexOffset);
+    os << trailerMagic;
+    os.flush();
+}
+
+bool isFramed(llvm::StringRef file) {
+    return file.size() >= headerSize + trailerSize &&
+           file.starts_with(headerMagic) && file.ends_with(trailerMagic);
+}
+
+// Bounds-checked cursor over a framed file; every read fails once the data
+// runs out instead of walking off the end of a truncated file.
+namespace {
+class Cursor {
+    llvm::StringRef data;
+    uint64_t pos;
+
+public:
+    Cursor(llvm::StringRef data, uint64_t pos) : data(data), pos(pos) {}
+
+    bool read32(uint32_t &out) {
+        if (pos > data.size() || data.size() - pos < 4)
+            return false;
+        out = endian::read32le(data.data() + pos);
+        pos += 4;
+        return true;
+    }
+    bool read64(uint64_t &out) {
+        if (pos > data.size() || data.size() - pos < 8)
+            return false;
+        out = endian::read64le(data.data() + pos);
+        pos += 8;
+        return true;
+    }
+    bool readBytes(uint64_t size, llvm::StringRef &out) {
+        if (pos > data.size() || data.size() - pos < size)
+            return false;
+        out = data.substr(pos, size);
+        pos += size;
+        return true;
+    }
+};
+} // namespace
+
+std::optional<std::vector<FrameInfo>> readFrameIndex(llvm::StringRef file) {
+    if (!isFramed(file) || file[4] != frameVersion) {
+        llvm::errs() << "Not a tinysea framed file\n";
+        return std::nullopt;
+    }
+
+    uint64_t indexOffset =
+        endian::read64le(file.data() + file.size() - trailerSize);
+    llvm::StringRef body = file.drop_back(trailerSize);
+    Cursor cursor(body, indexOffset);
+
+    uint32_t count;
+    if (indexOffset < headerSize || !cursor.read32(count)) {
+        llvm::errs() << "Damaged frame index\n";
+        return std::nullopt;
+    }
+
+    std::vector<FrameInfo> frames;
+    for (uint32_t i = 0; i < count; ++i) {
+        uint32_t nameSize;
+        llvm::StringRef name;
+        uint64_t frameOffset;
+        if (!cursor.read32(nameSize) || !cursor.readBytes(nameSize, name) ||
+            !cursor.read64(frameOffset) || frameOffset >= indexOffset) {
+            llvm::errs() << "Damaged frame index\n";
+            return std::nullopt;
+        }
+        frames.push_back({name.str(), frameOffset});
+    }
+    return frames;
+}
+
+bool readFrame(llvm::StringRef file, uint64_t offset, std::string &out) {
+    Cursor cursor(file.drop_back(trailerSize), offset + 1);
+    uint32_t nameSize;
+    llvm::StringRef name, payload;
+    uint64_t rawSize, packedSize;
+    if (offset >= file.size() || !cursor.read32(nameSize) ||
+        !cursor.readBytes(nameSize, name) || !cursor.read64(rawSize) ||
+        !cursor.read64(packedSize) || !cursor.readBytes(packedSize, payload)) {
+        llvm::errs() << "Truncated frame at offset " << offset << "\n";
+        return false;
+    }
+
+    uint8_t format = file[offset];
+    if (format == Stored) {
+        out += payload;
+        return true;
+    }
+    if (format != Zlib && format != Zstd) {
+        llvm::errs() << "Unknown frame format " << unsigned(format)
+                     << " in frame " << name << "\n";
+        return false;
+    }
+
+    llvm::SmallVector<uint8_t, 0> raw;
+    if (llvm::Error err = llvm::compression::decompress(
+            format == Zstd ? llvm::compression::Format::Zstd
+                           : llvm::compression::Format::Zlib,
+            llvm::arrayRefFromStringRef(payload), raw, rawSize)) {
+        llvm::errs() << "Failed to decompress frame " << name << ": "
+                     << llvm::toString(std::move(err)) << "\n";
+        return false;
+    }
+    out += llvm::toStringRef(raw);
+    return true;
+}
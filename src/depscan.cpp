@@ -0,0 +1,250 @@
+#include "stdafx.h"
+
+using namespace clang::tooling;
+using namespace clang::tooling::dependencies;
+
+static constexpr int64_t cacheVersion = 1;
+
+static uint64_t hashCommand(const CompileCommand &command) {
+    std::string text = command.Directory;
+    for (const std::string &arg : command.CommandLine) {
+        text += '\0';
+        text += arg;
+    }
+    return llvm::xxh3_64bits(llvm::arrayRefFromStringRef(text));
+}
+
+// scanner output is relative to the command's directory
+static std::string absoluteIn(llvm::StringRef directory, llvm::StringRef path) {
+    llvm::SmallString<256> result;
+    if (llvm::sys::path::is_relative(path))
+        result = directory;
+    llvm::sys::path::append(result, path);
+    llvm::sys::path::remove_dots(result, /*remove_dot_dot=*/true);
+    return result.str().str();
+}
+
+// stat() results shared by every TU that includes the same header
+namespace {
+class StampCache {
+    std::map<std::string, std::optional<IncludeClosure::File>> stamps;
+
+public:
+    const std::optional<IncludeClosure::File> &get(const std::string &path) {
+        auto [it, inserted] = stamps.try_emplace(path);
+        llvm::sys::fs::file_status status;
+        if (inserted && !llvm::sys::fs::status(path, status)) {
+            it->second = IncludeClosure::File{
+                path,
+                std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    status.getLastModificationTime().time_since_epoch())
+                    .count(),
+                status.getSize()};
+        }
+        return it->second;
+    }
+};
+} // namespace
+
+static bool isCurrent(const IncludeClosure &closure, uint64_t command,
+                      StampCache &stamps) {
+    if (closure.command != command)
+        return false;
+    for (const IncludeClosure::File &file : closure.files) {
+        const auto &stamp = stamps.get(file.path);
+        if (!stamp || stamp->mtime != file.mtime || stamp->size != file.size)
+            return false;
+    }
+    return true;
+}
+
+void DependencyCache::load(const std::string &path) {
+    auto bufferOrError = llvm::MemoryBuffer::getFile(
+        path, /*IsText=*/true, /*RequiresNullTerminator=*/false);
+    if (!bufferOrError)
+        return; // first run
+
+    auto jsonOrError = llvm::json::parse((*bufferOrError)->getBuffer());
+    if (!jsonOrError) {
+        llvm::errs() << "Ignoring unreadable dependency cache " << path << ": "
+                     << toString(jsonOrError.takeError()) << "\n";
+        return;
+    }
+    auto *root = jsonOrError->getAsObject();
+    if (!root || root->getInteger("version") != cacheVersion)
+        return;
+    auto *tus = root->getObject("translationUnits");
+    if (!tus)
+        return;
+
+    for (const auto &[source, value] : *tus) {
+        auto *entry = value.getAsObject();
+        auto *files = entry ? entry->getArray("files") : nullptr;
+        auto command = entry ? entry->getString("command") : std::nullopt;
+        auto key = entry ? entry->getString("key") : std::nullopt;
+        if (!files || !command || !key)
+            continue;
+
+        IncludeClosure closure;
+        if (command->getAsInteger(16, closure.command) ||
+            key->getAsInteger(16, closure.key))
+            continue;
+        for (const auto &fileValue : *files) {
+            auto *file = fileValue.getAsObject();
+            auto filePath = file ? file->getString("path") : std::nullopt;
+            auto mtime = file ? file->getInteger("mtime") : std::nullopt;
+            auto size = file ? file->getInteger("size") : std::nullopt;
+            if (filePath && mtime && size) {
+                closure.files.push_back(
+                    {filePath->str(), *mtime, static_cast<uint64_t>(*size)});
+            }
+        }
+        closures[source.str()] = std::move(closure);
+    }
+}
+
+void DependencyCache::save(const std::string &path) const {
+    auto err = llvm::writeToOutput(path, [&](llvm::raw_ostream &os) {
+        llvm::json::OStream json(os, 1);
+        json.object([&] {
+            json.attribute("version", cacheVersion);
+            json.attributeObject("translationUnits", [&] {
+                for (const auto &[source, closure] : closures) {
+                    json.attributeObject(source, [&] {
+                        json.attribute("command",
+                                       llvm::utohexstr(closure.command));
+                        json.attribute("key", llvm::utohexstr(closure.key));
+                        json.attributeArray("files", [&] {
+                            for (const auto &file : closure.files) {
+                                json.object([&] {
+                                    json.attribute("path", file.path);
+                                    json.attribute("mtime", file.mtime);
+                                    json.attribute("size", int64_t(file.size));
+                                });
+                            }
+                        });
+                    });
+                }
+            });
+        });
+        return llvm::Error::success();
+    });
+    if (err) {
+        llvm::errs() << "Failed to write dependency cache " << path << ": "
+                     << llvm::toString(std::move(err)) << "\n";
+    }
+}
+
+void DependencyCache::update(const CompilationDatabase &compilations,
+                             const std::vector<std::string> &sources,
+                             unsigned jobs, Stats &stats) {
+    double scanMs = 0;
+    {
+        PhaseTimer timer("ScanDependencies", scanMs);
+
+        StampCache stamps;
+        std::vector<CompileCommand> commands(sources.size());
+        std::vector<size_t> stale;
+        for (size_t i = 0; i < sources.size(); ++i) {
+            std::vector<CompileCommand> found =
+                compilations.getCompileCommands(sources[i]);
+            if (found.empty()) {
+                closures.erase(sources[i]);
+                continue;
+            }
+            commands[i] = std::move(found.front());
+
+            auto it = closures.find(sources[i]);
+            if (it != closures.end() &&
+                isCurrent(it->second, hashCommand(commands[i]), stamps)) {
+                stats.add(Stats::ClosuresCached);
+                continue;
+            }
+            closures.erase(sources[i]);
+            stale.push_back(i);
+        }
+
+        // the service's file cache is shared by every worker, so a header
+        // is read and minimized once however many TUs include it
+        DependencyScanningService service(ScanningMode::DependencyDirectivesScan,
+                                          ScanningOutputFormat::Full);
+        std::vector<std::vector<std::string>> deps(sources.size());
+        std::vector<std::string> errors(sources.size());
+        {
+            llvm::ThreadPool pool(llvm::hardware_concurrency(jobs));
+            for (size_t i : stale) {
+                pool.async([&, i] {
+                    DependencyScanningTool tool(service);
+                    auto result = tool.getTranslationUnitDependencies(
+                        commands[i].CommandLine, commands[i].Directory, {},
+                        [](const ModuleID &, ModuleOutputKind) {
+                            return std::string();
+                        });
+                    if (!result) {
+                        errors[i] = llvm::toString(result.takeError());
+                        return;
+                    }
+                    deps[i] = std::move(result->FileDeps);
+                });
+            }
+            pool.wait();
+        }
+
+        for (size_t i : stale) {
+            if (!errors[i].empty()) {
+                llvm::errs() << "Failed to scan " << sources[i] << ": "
+                             << errors[i] << "\n";
+                continue;
+            }
+            stats.add(Stats::ClosuresScanned);
+
+            IncludeClosure closure;
+            closure.command = hashCommand(commands[i]);
+            std::string keyText = llvm::utohexstr(closure.command);
+            bool complete = true;
+            for (const std::string &dep : deps[i]) {
+                const auto &stamp =
+                    stamps.get(absoluteIn(commands[i].Directory, dep));
+                if (!stamp) {
+                    complete = false;
+                    break;
+                }
+                closure.files.push_back(*stamp);
+                keyText += '\0' + stamp->path + '\0' +
+                           std::to_string(stamp->mtime) + '\0' +
+                           std::to_string(stamp->size);
+            }
+            if (!complete)
+                continue;
+            closure.key =
+                llvm::xxh3_64bits(llvm::arrayRefFromStringRef(keyText));
+            closures[sources[i]] = std::move(closure);
+        }
+    }
+    stats.addPhase("scanDependencies", scanMs);
+}
+
+std::vector<std::string>
+DependencyCache::affectedBy(const std::vector<std::string> &changed,
+                            const std::vector<std::string> &sources) const {
+    std::set<std::string> changedPaths;
+    for (const std::string &path : changed)
+        changedPaths.insert(normalizedPath(path));
+
+    std::vector<std::string> affected;
+    for (const std::string &source : sources) {
+        auto it = closures.find(source);
+        bool hit = it == closures.end() ||
+                   llvm::any_of(it->second.files, [&](const auto &file) {
+                       return changedPaths.count(file.path);
+                   });
+        if (hit)
+            affected.push_back(source);
+    }
+    return affected;
+}
+
+const IncludeClosure *DependencyCache::find(const std::string &source) const {
+    auto it = closures.find(source);
+    return it == closures.end() ? nullptr : &it->second;
+}
@@ -0,0 +1,429 @@
+#include "stdafx.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+class TimedFile : public llvm::vfs::File {
+    std::unique_ptr<llvm::vfs::File> file;
+    Stats &stats;
+
+public:
+    TimedFile(std::unique_ptr<llvm::vfs::File> file, Stats &stats)
+        : file(std::move(file)), stats(stats) {}
+
+    llvm::ErrorOr<llvm::vfs::Status> status() override {
+        return file->status();
+    }
+    llvm::ErrorOr<std::string> getName() override { return file->getName(); }
+    llvm::ErrorOr<std::unique_ptr<llvm::MemoryBuffer>>
+    getBuffer(const llvm::Twine &name, int64_t fileSize,
+              bool requiresNullTerminator, bool isVolatile) override {
+        BlockedTimer timer(stats, Stats::ReadBlockedUs);
+        return file->getBuffer(name, fileSize, requiresNullTerminator,
+                               isVolatile);
+    }
+    std::error_code close() override { return file->close(); }
+};
+
+// A cached file's buffers are views of the shared copy, which outlives
+// every TU.
+class CachedFile : public llvm::vfs::File {
+    llvm::vfs::Status fileStatus;
+    std::shared_ptr<const llvm::MemoryBuffer> buffer;
+
+public:
+    CachedFile(llvm::vfs::Status status,
+               std::shared_ptr<const llvm::MemoryBuffer> buffer)
+        : fileStatus(std::move(status)), buffer(std::move(buffer)) {}
+
+    llvm::ErrorOr<llvm::vfs::Status> status() override { return fileStatus; }
+    llvm::ErrorOr<std::string> getName() override {
+        return fileStatus.getName().str();
+    }
+    llvm::ErrorOr<std::unique_ptr<llvm::MemoryBuffer>>
+    getBuffer(const llvm::Twine &name, int64_t fileSize,
+              bool requiresNullTerminator, bool isVolatile) override {
+        return llvm::MemoryBuffer::getMemBuffer(buffer->getMemBufferRef(),
+                                                requiresNullTerminator);
+    }
+    std::error_code close() override { return {}; }
+};
+
+class CachedDirIter : public llvm::vfs::detail::DirIterImpl {
+    std::shared_ptr<const std::vector<llvm::vfs::directory_entry>> entries;
+    size_t next = 0;
+
+public:
+    explicit CachedDirIter(
+        std::shared_ptr<const std::vector<llvm::vfs::directory_entry>> entries)
+        : entries(std::move(entries)) {
+        increment();
+    }
+
+    std::error_code increment() override {
+        CurrentEntry = next < entries->size() ? (*entries)[next++]
+                                              : llvm::vfs::directory_entry();
+        return {};
+    }
+};
+
+// Asks the kernel to start reading `path` into the page cache and returns
+// without waiting for the data where the platform allows it. This stands
+// in for batched io_uring reads: readahead/posix_fadvise need no liburing
+// dependency and no buffers to hand back, and the parse later reads the
+// file through the page cache either way.
+bool prefetchFile(const std::string &path) {
+#if defined(__unix__) || defined(__APPLE__)
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return false;
+#if defined(__linux__)
+    struct stat st;
+    bool ok = fstat(fd, &st) == 0 && readahead(fd, 0, st.st_size) == 0;
+#elif defined(POSIX_FADV_WILLNEED)
+    bool ok = posix_fadvise(fd, 0, 0, POSIX_FADV_WILLNEED) == 0;
+#else
+    // no hint available, so read the file through once instead
+    char chunk[64 * 1024];
+    bool ok = true;
+    for (ssize_t n; (n = ::read(fd, chunk, sizeof(chunk))) != 0;) {
+        if (n < 0) {
+            ok = false;
+            break;
+        }
+    }
+#endif
+    ::close(fd);
+    return ok;
+#else
+    return !llvm::MemoryBuffer::getFile(path).getError();
+#endif
+}
+
+} // namespace
+
+TimedFileSystem::TimedFileSystem(
+    llvm::IntrusiveRefCntPtr<llvm::vfs::FileSystem> fs, Stats &stats)
+    : ProxyFileSystem(std::move(fs)), stats(stats) {}
+
+llvm::ErrorOr<llvm::vfs::Status>
+TimedFileSystem::status(const llvm::Twine &path) {
+    stats.add(Stats::FsStatCalls);
+    BlockedTimer timer(stats, Stats::ReadBlockedUs);
+    return ProxyFileSystem::status(path);
+}
+
+llvm::ErrorOr<std::unique_ptr<llvm::vfs::File>>
+TimedFileSystem::openFileForRead(const llvm::Twine &path) {
+    stats.add(Stats::FsOpenCalls);
+    auto file = [&] {
+        BlockedTimer timer(stats, Stats::ReadBlockedUs);
+        return ProxyFileSystem::openFileForRead(path);
+    }();
+    if (!file)
+        return file;
+    return std::make_unique<TimedFile>(std::move(*file), stats);
+}
+
+llvm::vfs::directory_iterator
+TimedFileSystem::dir_begin(const llvm::Twine &dir, std::error_code &ec) {
+    stats.add(Stats::FsDirListings);
+    BlockedTimer timer(stats, Stats::ReadBlockedUs);
+    return ProxyFileSystem::dir_begin(dir, ec);
+}
+
+CachingFileSystem::CachingFileSystem(
+    llvm::IntrusiveRefCntPtr<llvm::vfs::FileSystem> fs, Stats &stats)
+    : ProxyFileSystem(std::move(fs)), stats(stats) {}
+
+llvm::ErrorOr<llvm::vfs::Status>
+CachingFileSystem::status(const llvm::Twine &path) {
+    llvm::SmallString<256> key;
+    path.toVector(key);
+    if (!llvm::sys::path::is_absolute(key))
+        return ProxyFileSystem::status(path);
+
+    {
+        std::shared_lock<std::shared_mutex> lock(mutex);
+        auto it = statuses.find(key);
+        if (it != statuses.end()) {
+            stats.add(Stats::StatCacheHits);
+            return it->second;
+        }
+    }
+    llvm::ErrorOr<llvm::vfs::Status> result = ProxyFileSystem::status(key);
+    std::unique_lock<std::shared_mutex> lock(mutex);
+    return statuses.try_emplace(key, result).first->second;
+}
+
+llvm::ErrorOr<std::unique_ptr<llvm::vfs::File>>
+CachingFileSystem::openFileForRead(const llvm::Twine &path) {
+    llvm::SmallString<256> key;
+    path.toVector(key);
+    if (!llvm::sys::path::is_absolute(key))
+        return ProxyFileSystem::openFileForRead(path);
+
+    std::shared_ptr<const llvm::MemoryBuffer> buffer;
+    std::optional<llvm::vfs::Status> status;
+    {
+        std::shared_lock<std::shared_mutex> lock(mutex);
+        auto content = contents.find(key);
+        auto stat = statuses.find(key);
+        if (stat != statuses.end() && !stat->second)
+            return stat->second.getError();
+        if (content != contents.end() && stat != statuses.end()) {
+            buffer = content->second;
+            status = *stat->second;
+        }
+    }
+
+    if (buffer) {
+        stats.add(Stats::ContentCacheHits);
+    } else {
+        auto file = ProxyFileSystem::openFileForRead(key);
+        if (!file) {
+            std::unique_lock<std::shared_mutex> lock(mutex);
+            statuses.try_emplace(key, file.getError());
+            return file.getError();
+        }
+        auto fileStatus = (*file)->status();
+        if (!fileStatus)
+            return fileStatus.getError();
+        auto read = (*file)->getBuffer(key, fileStatus->getSize(),
+                                       /*RequiresNullTerminator=*/true,
+                                       /*IsVolatile=*/false);
+        if (!read)
+            return read.getError();
+
+        // another worker may have read it meanwhile; everyone uses the
+        // first copy so no buffer is ever replaced under a reader
+        std::unique_lock<std::shared_mutex> lock(mutex);
+        buffer = contents.try_emplace(key, std::move(*read)).first->second;
+        statuses.insert_or_assign(key, *fileStatus);
+        status = *fileStatus;
+    }
+
+    return std::make_unique<CachedFile>(
+        llvm::vfs::Status::copyWithNewName(*status, key), std::move(buffer));
+}
+
+llvm::vfs::directory_iterator
+CachingFileSystem::dir_begin(const llvm::Twine &dir, std::error_code &ec) {
+    llvm::SmallString<256> key;
+    dir.toVector(key);
+    if (!llvm::sys::path::is_absolute(key))
+        return ProxyFileSystem::dir_begin(dir, ec);
+
+    std::shared_ptr<const Listing> listing;
+    {
+        std::shared_lock<std::shared_mutex> lock(mutex);
+        auto it = listings.find(key);
+        if (it != listings.end()) {
+            stats.add(Stats::DirCacheHits);
+            listing = it->second;
+        }
+    }
+
+    if (!listing) {
+        auto entries = std::make_shared<Listing>();
+        llvm::vfs::directory_iterator it = ProxyFileSystem::dir_begin(key, ec);
+        for (; !ec && it != llvm::vfs::directory_iterator(); it.increment(ec))
+            entries->push_back(*it);
+        if (ec)
+            return {};
+
+        std::unique_lock<std::shared_mutex> lock(mutex);
+        listing = listings.try_emplace(key, std::move(entries)).first->second;
+    }
+
+    ec = {};
+    return llvm::vfs::directory_iterator(
+        std::make_shared<CachedDirIter>(std::move(listing)));
+}
+
+void CachingFileSystem::invalidate(llvm::StringRef path) {
+    std::unique_lock<std::shared_mutex> lock(mutex);
+    statuses.erase(path);
+    auto it = contents.find(path);
+    if (it != contents.end()) {
+        // the SourceManager of a TU still being parsed may point into it
+        retired.push_back(std::move(it->second));
+        contents.erase(it);
+    }
+}
+
+WorkingDirectoryFileSystem::WorkingDirectoryFileSystem(
+    llvm::IntrusiveRefCntPtr<llvm::vfs::FileSystem> fs)
+    : ProxyFileSystem(std::move(fs)) {
+    llvm::SmallString<256> cwd;
+    if (!llvm::sys::fs::current_path(cwd))
+        workingDirectory = std::string(cwd);
+}
+
+llvm::SmallString<256>
+WorkingDirectoryFileSystem::absolute(const llvm::Twine &path) const {
+    llvm::SmallString<256> result;
+    path.toVector(result);
+    if (!llvm::sys::path::is_absolute(result)) {
+        llvm::SmallString<256> relative = std::move(result);
+        result = workingDirectory;
+        llvm::sys::path::append(result, relative);
+    }
+    return result;
+}
+
+llvm::ErrorOr<llvm::vfs::Status>
+WorkingDirectoryFileSystem::status(const llvm::Twine &path) {
+    return ProxyFileSystem::status(absolute(path));
+}
+
+bool WorkingDirectoryFileSystem::exists(const llvm::Twine &path) {
+    return ProxyFileSystem::exists(absolute(path));
+}
+
+llvm::ErrorOr<std::unique_ptr<llvm::vfs::File>>
+WorkingDirectoryFileSystem::openFileForRead(const llvm::Twine &path) {
+    return ProxyFileSystem::openFileForRead(absolute(path));
+}
+
+llvm::vfs::directory_iterator
+WorkingDirectoryFileSystem::dir_begin(const llvm::Twine &dir,
+                                      std::error_code &ec) {
+    return ProxyFileSystem::dir_begin(absolute(dir), ec);
+}
+
+std::error_code
+WorkingDirectoryFileSystem::getRealPath(const llvm::Twine &path,
+                                        llvm::SmallVectorImpl<char> &output) {
+    return ProxyFileSystem::getRealPath(absolute(path), output);
+}
+
+std::error_code WorkingDirectoryFileSystem::isLocal(const llvm::Twine &path,
+                                                    bool &result) {
+    return ProxyFileSystem::isLocal(absolute(path), result);
+}
+
+llvm::ErrorOr<std::string>
+WorkingDirectoryFileSystem::getCurrentWorkingDirectory() const {
+    return workingDirectory;
+}
+
+std::error_code WorkingDirectoryFileSystem::setCurrentWorkingDirectory(
+    const llvm::Twine &path) {
+    llvm::SmallString<256> dir = absolute(path);
+    llvm::ErrorOr<llvm::vfs::Status> status = ProxyFileSystem::status(dir);
+    if (!status)
+        return status.getError();
+    if (!status->isDirectory())
+        return std::make_error_code(std::errc::not_a_directory);
+    workingDirectory = std::string(dir);
+    return {};
+}
+
+Prefetcher::Prefetcher(std::vector<std::vector<std::string>> closures,
+                       unsigned depth, Stats &stats)
+    : closures(std::move(closures)), depth(depth), stats(stats),
+      thread([this] { run(); }) {}
+
+Prefetcher::~Prefetcher() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wake.notify_one();
+    thread.join();
+}
+
+void Prefetcher::notifyStarted() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        ++started;
+    }
+    wake.notify_one();
+}
+
+void Prefetcher::run() {
+    std::unordered_set<std::string> done;
+    for (size_t next = 0; next < closures.size(); ++next) {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            wake.wait(lock,
+                      [&] { return stopping || next < started + depth; });
+            if (stopping)
+                return;
+        }
+        for (const std::string &path : closures[next]) {
+            if (done.insert(path).second && prefetchFile(path))
+                stats.add(Stats::FilesPrefetched);
+        }
+    }
+}
+
+AsyncWriter::AsyncWriter(Stats &stats, CachingFileSystem *cache)
+    : stats(stats), cache(cache), thread([this] { run(); }) {}
+
+AsyncWriter::~AsyncWriter() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wake.notify_one();
+    thread.join();
+}
+
+void AsyncWriter::write(std::string path, std::string content) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        queue.emplace_back(std::move(path), std::move(content));
+    }
+    wake.notify_one();
+}
+
+void AsyncWriter::wait() {
+    BlockedTimer timer(stats, Stats::WriteBlockedUs);
+    std::unique_lock<std::mutex> lock(mutex);
+    drained.wait(lock, [&] { return queue.empty() && !writing; });
+}
+
+void AsyncWriter::run() {
+    std::vector<std::pair<std::string, std::string>> batch;
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            writing = false;
+            if (queue.empty())
+                drained.notify_all();
+            wake.wait(lock, [&] { return stopping || !queue.empty(); });
+            if (queue.empty())
+                return; // stopping with nothing left to write
+            batch.swap(queue);
+            writing = true;
+        }
+
+        for (const auto &[path, content] : batch) {
+            if (writeFile(path, content, cache))
+                stats.add(Stats::AsyncWrites);
+        }
+        batch.clear();
+    }
+}
+
+bool writeFile(llvm::StringRef path, llvm::StringRef content,
+               CachingFileSystem *cache) {
+    if (auto err = llvm::writeToOutput(path, [&](llvm::raw_ostream &out) {
+            out << content;
+            return llvm::Error::success();
+        })) {
+        llvm::errs() << "Failed to write " << path << ": "
+                     << llvm::toString(std::move(err)) << "\n";
+        return false;
+    }
+    if (cache)
+        cache->invalidate(path);
+    return true;
+}
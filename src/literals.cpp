@@ -0,0 +1,172 @@
+#include "stdafx.h"
+
+using namespace clang;
+
+// The type [lex.icon] gives an integer literal with this value, base and
+// suffix: the first candidate type the value fits in.
+static QualType integerLiteralType(const ASTContext &ctx,
+                                   const llvm::APInt &value, bool decimal,
+                                   bool isUnsigned, unsigned longs) {
+    std::vector<QualType> candidates;
+    if (longs == 0) {
+        if (!isUnsigned)
+            candidates.push_back(ctx.IntTy);
+        if (isUnsigned || !decimal)
+            candidates.push_back(ctx.UnsignedIntTy);
+    }
+    if (longs <= 1) {
+        if (!isUnsigned)
+            candidates.push_back(ctx.LongTy);
+        if (isUnsigned || !decimal)
+            candidates.push_back(ctx.UnsignedLongTy);
+    }
+    if (!isUnsigned)
+        candidates.push_back(ctx.LongLongTy);
+    if (isUnsigned || !decimal)
+        candidates.push_back(ctx.UnsignedLongLongTy);
+
+    for (QualType type : candidates) {
+        unsigned width = ctx.getIntWidth(type);
+        unsigned needed = value.getActiveBits();
+        if (type->isSignedIntegerType() ? needed < width : needed <= width)
+            return type;
+    }
+    return QualType();
+}
+
+std::string shortestIntegerSpelling(const IntegerLiteral *literal,
+                                    const ASTContext &ctx) {
+    const llvm::APInt &value = literal->getValue();
+    QualType type = literal->getType();
+
+    static const struct {
+        const char *text;
+        bool isUnsigned;
+        unsigned longs;
+    } suffixes[] = {{"", false, 0},  {"u", true, 0},   {"l", false, 1},
+                    {"ul", true, 1}, {"ll", false, 2}, {"ull", true, 2}};
+
+    std::string decimal = llvm::toString(value, 10, /*Signed=*/false);
+    std::string hex =
+        "0x" + llvm::StringRef(llvm::toString(value, 16, /*Signed=*/false))
+                   .lower();
+
+    std::string best;
+    for (const auto &suffix : suffixes) {
+        for (bool isDecimal : {true, false}) {
+            std::string spelling = (isDecimal ? decimal : hex) + suffix.text;
+            if (!best.empty() && spelling.size() >= best.size())
+                continue;
+            QualType result = integerLiteralType(
+                ctx, value, isDecimal, suffix.isUnsigned, suffix.longs);
+            if (!result.isNull() && ctx.hasSameType(result, type))
+                best = spelling;
+        }
+    }
+    return best;
+}
+
+static bool parsesTo(const llvm::APFloat &value, llvm::StringRef spelling) {
+    llvm::APFloat parsed(value.getSemantics());
+    auto status =
+        parsed.convertFromString(spelling, llvm::APFloat::rmNearestTiesToEven);
+    if (!status) {
+        llvm::consumeError(status.takeError());
+        return false;
+    }
+    return parsed.bitwiseIsEqual(value);
+}
+
+// shortest significant digits and decimal exponent that round-trip, as in
+// value = d.ddd * 10^exponent
+static bool shortestDigits(const llvm::APFloat &value, std::string &digits,
+                           int &exponent) {
+    // enough decimal digits to round-trip any value of this precision
+    unsigned bits = llvm::APFloat::semanticsPrecision(value.getSemantics());
+    unsigned maxDigits = 2 + bits * 59 / 196;
+    for (unsigned precision = 1; precision <= maxDigits; ++precision) {
+        llvm::SmallString<64> text;
+        // zero padding means always use scientific notation: d.dddE+xx
+        value.toString(text, precision, /*FormatMaxPadding=*/0);
+        if (!parsesTo(value, text))
+            continue;
+
+        llvm::StringRef mantissa, exp;
+        std::tie(mantissa, exp) = llvm::StringRef(text).split('E');
+        digits.clear();
+        for (char c : mantissa)
+            if (isDigit(c))
+                digits.push_back(c);
+        while (digits.size() > 1 && digits.back() == '0')
+            digits.pop_back();
+
+        exp.consume_front("+");
+        if (exp.empty())
+            exponent = 0;
+        else if (exp.getAsInteger(10, exponent))
+            return false;
+        return !digits.empty();
+    }
+    return false;
+}
+
+std::string shortestFloatingSpelling(const FloatingLiteral *literal,
+                                     const ASTContext &ctx) {
+    const llvm::APFloat &value = literal->getValue();
+    if (!value.isFinite() || value.isNegative())
+        return "";
+
+    const BuiltinType *builtin = literal->getType()->getAs<BuiltinType>();
+    if (!builtin)
+        return "";
+    const char *suffix;
+    switch (builtin->getKind()) {
+    case BuiltinType::Float:
+        suffix = "f";
+        break;
+    case BuiltinType::Double:
+        suffix = "";
+        break;
+    case BuiltinType::LongDouble:
+        suffix = "l";
+        break;
+    default:
+        return "";
+    }
+
+    std::string digits;
+    int exponent;
+    if (!shortestDigits(value, digits, exponent))
+        return "";
+    int count = digits.size();
+
+    std::vector<std::string> candidates;
+
+    // fixed notation, with the point wherever the exponent puts it
+    int point = exponent + 1;
+    if (point <= 0)
+        candidates.push_back("." + std::string(-point, '0') + digits);
+    else if (point >= count)
+        candidates.push_back(digits + std::string(point - count, '0') + ".");
+    else
+        candidates.push_back(digits.substr(0, point) + "." +
+                             digits.substr(point));
+
+    // scientific notation with an integral mantissa, e.g. 15e2 for 1500.0
+    int shifted = exponent - (count - 1);
+    if (shifted != 0)
+        candidates.push_back(digits + "e" + std::to_string(shifted));
+
+    // and with a single leading digit, e.g. 1.5e-7
+    if (count > 1)
+        candidates.push_back(digits.substr(0, 1) + "." + digits.substr(1) +
+                             "e" + std::to_string(exponent));
+
+    std::string best;
+    for (const auto &candidate : candidates) {
+        if ((best.empty() || candidate.size() < best.size()) &&
+            parsesTo(value, candidate))
+            best = candidate;
+    }
+    return best.empty() ? best : best + suffix;
+}
@@ -4,21 +4,134 @@
 using namespace clang;
 using namespace clang::tooling;
 
-void processCMakeProject(const std::string &projectDir,
+using Clock = std::chrono::steady_clock;
+
+// Rewrites a single file read from stdin and writes the result to stdout.
+// This skips the compilation database and ClangTool setup entirely, so it is
+// the cheap path for piping one standalone file through tinysea.
+int processStdin(const std::string &filename,
+                 const std::vector<std::string> &extraArgs, Renamer &renamer,
+                 const ToolOptions &options, Clock::time_point startTime,
+                 bool reportLatency) {
+    auto input = llvm::MemoryBuffer::getSTDIN();
+    if (!input) {
+        llvm::errs() << "Failed to read stdin: " << input.getError().message()
+                     << "\n";
+        return 1;
+    }
+
+    std::vector<std::string> args = {"-std=c++20"};
+    args.insert(args.end(), extraArgs.begin(), extraArgs.end());
+
+    llvm::StringRef code = (*input)->getBuffer();
+    bool ok = clang::tooling::runToolOnCodeWithArgs(
+        std::make_unique<CustomFrontendAction>(renamer, options), code, args,
+        filename, "tinysea");
+    if (!ok) {
+        llvm::errs() << "Failed to process " << filename << "\n";
+        return 1;
+    }
+
+    const auto &rewritten = renamer.getRewrittenFiles();
+    auto it = rewritten.find(filename);
+    llvm::StringRef output =
+        it != rewritten.end() ? llvm::StringRef(it->second) : code;
+
+    double outputMs = 0;
+    {
+        PhaseTimer timer("Output", outputMs, filename);
+        llvm::outs() << output;
+        llvm::outs().flush();
+    }
+    renamer.getStats().addPhase("output", outputMs);
+
+    double latencyMs =
+        std::chrono::duration<double, std::milli>(Clock::now() - startTime)
+            .count();
+    renamer.getStats().addPhase("startupToFirstByte", latencyMs);
+    if (reportLatency)
+        llvm::errs() << "startup-to-first-byte: " << latencyMs << " ms\n";
+
+    // a regression is turned into the exit status by main, after the mapping
+    // for the output we already printed has been saved
+    if (options.verify)
+        verifyRewrite({code.str(), output.str()}, filename, args,
+                      renamer.getStats());
+
+    return 0;
+}
+
+// the real file system, with time spent waiting on it counted in `stats`.
+// Each call has its own working directory: ClangTool::run moves it to the
+// compile command's directory, which on the getRealFileSystem() singleton
+// would be the process-wide one every other tool resolves paths against.
+llvm::IntrusiveRefCntPtr<llvm::vfs::FileSystem>
+timedFileSystem(Stats &stats) {
+    return llvm::makeIntrusiveRefCnt<TimedFileSystem>(
+        llvm::vfs::createPhysicalFileSystem(), stats);
+}
+
+// Runs one ClangTool per source file on a thread pool. The Renamer and
+// Stats are shared and internally locked; everything else, the file system
+// the tool sees included, is per file. Returns false if any file failed.
+bool runParallel(const CompilationDatabase &compilations,
+                 const std::vector<std::string> &sourceFiles, Renamer &renamer,
+                 const ToolOptions &options,
+                 llvm::function_ref<
+                     llvm::IntrusiveRefCntPtr<llvm::vfs::FileSystem>()>
+                     makeFileSystem) {
+    llvm::ThreadPool pool(llvm::hardware_concurrency(options.jobs));
+    std::atomic<unsigned> failures = 0;
+
+    for (const auto &file : sourceFiles) {
+        pool.async([&, file] {
+            if (options.timeTraceGranularity)
+                llvm::timeTraceProfilerInitialize(options.timeTraceGranularity,
+                                                  "tinysea");
+
+            clang::tooling::ClangTool tool(
+                compilations, {file},
+                std::make_shared<clang::PCHContainerOperations>(),
+                makeFileSystem());
+            CustomActionFactory factory(renamer, options);
+            if (tool.run(&factory))
+                ++failures;
+
+            if (options.timeTraceGranularity)
+                llvm::timeTraceProfilerFinishThread();
+        });
+    }
+    pool.wait();
+
+    if (failures)
+        llvm::errs() << "Tool failed on " << failures << " file(s)\n";
+    return failures == 0;
+}
+
+// Returns 0 only if every translation unit was processed and every output
+// written.
+int processCMakeProject(const std::string &projectDir,
                          const std::string &outputFile, Renamer &renamer,
+                         const ToolOptions &options,
                          llvm::cl::OptionCategory &category) {
     std::unique_ptr<clang::tooling::CompilationDatabase> db;
     std::string error;
+    Stats &stats = renamer.getStats();
 
-    db = clang::tooling::CompilationDatabase::loadFromDirectory(projectDir,
-                                                                error);
+    double loadMs = 0;
+    {
+        PhaseTimer timer("LoadCompileDB", loadMs, projectDir);
+        db = clang::tooling::CompilationDatabase::loadFromDirectory(projectDir,
+                                                                    error);
+    }
+    stats.addPhase("loadCompileDB", loadMs);
 
     if (!db) {
         llvm::errs() << "Failed to find compilation database. Tried:" << "  "
                      << projectDir << "/build\n"
                      << "Error: " << error << "\n";
 
-        return;
+        return 1;
     }
 
     // Build arguments with Haiku-specific includes
@@ -63,24 +176,382 @@ void processCMakeProject(const std::string &projectDir,
     if (!OptionsParser) {
         llvm::errs() << "Failed to create options parser: "
                      << llvm::toString(OptionsParser.takeError()) << "\n";
-        return;
+        return 1;
+    }
+
+    std::vector<std::string> sources = OptionsParser->getSourcePathList();
+
+    // unless given, the project is the directory holding every source and
+    // build directory; headers outside it are guarded like system headers
+    ToolOptions runOptions = options;
+    if (runOptions.projectRoot.empty()) {
+        std::vector<std::string> paths;
+        for (const std::string &source : sources)
+            paths.push_back(normalizedPath(source));
+        for (const auto &command : db->getAllCompileCommands())
+            paths.push_back(normalizedPath(command.Directory) + "/");
+        runOptions.projectRoot = commonDirectory(paths);
+    }
+    // declarations in the project's own headers are renamed along with
+    // their uses in every TU
+    runOptions.rewriteHeaders = true;
+
+    if (options.shard)
+        sources = options.shard->select(sources);
+    std::string cachePath = options.depsCache.empty()
+                                ? projectDir + "/tinysea-deps.json"
+                                : options.depsCache;
+    // the dependency scan only runs for the incremental options, or when
+    // --deps-cache is given to keep the closures current for later runs
+    bool incremental = !options.changedFiles.empty() || options.listAffected ||
+                       !options.depsCache.empty();
+    DependencyCache cache;
+    if (incremental) {
+        cache.load(cachePath);
+        cache.update(OptionsParser->getCompilations(), sources, options.jobs,
+                     stats);
+        cache.save(cachePath);
+    } else if (options.prefetch) {
+        // closures left by an earlier scan, if any; a stale one only costs
+        // a wasted read
+        cache.load(cachePath);
+    }
+
+    // under --changed-files, new names are still checked against every TU,
+    // not only the ones this run rewrites; a shard scans only its own, and
+    // merge-mappings checks the final names against what all shards saw
+    std::vector<std::string> scanned = sources;
+    if (!options.changedFiles.empty()) {
+        sources = cache.affectedBy(options.changedFiles, sources);
+        if (sources.empty() && !options.listAffected) {
+            llvm::errs() << "No translation units affected\n";
+            return 0;
+        }
+    }
+    if (options.listAffected) {
+        for (const std::string &source : sources) {
+            const IncludeClosure *closure = cache.find(source);
+            llvm::outs() << source << '\t'
+                         << (closure ? llvm::utohexstr(closure->key) : "")
+                         << '\n';
+        }
+        return 0;
+    }
+
+    // with fresh closures, every file the run will read is lexed for names
+    // to keep clear of before the first one is handed out; otherwise each
+    // file is lexed when a TU first enters it
+    if (incremental) {
+        scanIncludeClosures(
+            cache, scanned, runOptions.projectRoot, options.jobs,
+            options.guardExternalNames, renamer.getExternalNames(),
+            [&](llvm::ArrayRef<llvm::StringRef> identifiers) {
+                renamer.addProjectSpellings(identifiers);
+            },
+            stats);
+    }
+
+    llvm::IntrusiveRefCntPtr<CachingFileSystem> fileCache;
+    if (options.sharedFileCache) {
+        fileCache = llvm::makeIntrusiveRefCnt<CachingFileSystem>(
+            timedFileSystem(stats), stats);
+        runOptions.fileCache = fileCache.get();
+    }
+    auto makeFileSystem =
+        [&]() -> llvm::IntrusiveRefCntPtr<llvm::vfs::FileSystem> {
+        if (fileCache)
+            return llvm::makeIntrusiveRefCnt<WorkingDirectoryFileSystem>(
+                fileCache);
+        return timedFileSystem(stats);
+    };
+    std::optional<Prefetcher> prefetcher;
+    if (options.prefetch) {
+        std::vector<std::vector<std::string>> closures;
+        for (const std::string &source : sources) {
+            std::vector<std::string> files;
+            if (const IncludeClosure *closure = cache.find(source)) {
+                for (const auto &file : closure->files)
+                    files.push_back(file.path);
+            } else {
+                files.push_back(source);
+            }
+            closures.push_back(std::move(files));
+        }
+        prefetcher.emplace(std::move(closures), options.prefetch, stats);
+        runOptions.prefetcher = &*prefetcher;
+    }
+    std::optional<AsyncWriter> writer;
+    if (options.asyncWrites) {
+        writer.emplace(stats, runOptions.fileCache);
+        runOptions.writer = &*writer;
+    }
+    std::optional<OutputPipeline> pipeline;
+    if (options.pipelineDepth) {
+        pipeline.emplace(renamer, runOptions, options.pipelineDepth,
+                         options.serializeJobs);
+        runOptions.pipeline = &*pipeline;
+    }
+
+    bool complete = true;
+    if (options.jobs > 1) {
+        complete = runParallel(OptionsParser->getCompilations(), sources,
+                               renamer, runOptions, makeFileSystem);
+    } else {
+        // Run tool with proper error handling
+        clang::tooling::ClangTool tool(
+            OptionsParser->getCompilations(), sources,
+            std::make_shared<clang::PCHContainerOperations>(),
+            makeFileSystem());
+
+        auto factory =
+            std::make_unique<CustomActionFactory>(renamer, runOptions);
+        if (int result = tool.run(factory.get())) {
+            llvm::errs() << "Tool failed with code: " << result << "\n";
+            complete = false;
+        }
+    }
+    if (pipeline)
+        pipeline->finish();
+    if (writer)
+        writer->wait();
+
+    // headers were held back so that every TU read them as they were; the
+    // source files rewritten so far reference the new names either way
+    if (!runOptions.inMemoryOutput) {
+        for (const auto &[path, content] : renamer.takeRewrittenFiles())
+            complete &= writeFile(path, content, runOptions.fileCache);
+    }
+
+    if (options.verify) {
+        verifyRewrites(OptionsParser->getCompilations(), sources,
+                       renamer.getVerifyBuffers(), options.jobs, stats);
+    }
+
+    if (options.deadCodeElimination) {
+        std::error_code ec;
+        std::unique_ptr<llvm::raw_fd_ostream> report;
+        if (!options.deadCodeReport.empty()) {
+            report = std::make_unique<llvm::raw_fd_ostream>(
+                options.deadCodeReport, ec);
+            if (ec) {
+                llvm::errs() << "Failed to open " << options.deadCodeReport
+                             << ": " << ec.message() << "\n";
+                report.reset();
+            }
+        }
+        renamer.eliminateDeadCode(options.keepSymbols,
+                                  report ? report.get() : &llvm::errs());
+    }
+
+    if (options.amalgamate) {
+        IncludeGraph graph = renamer.getIncludeGraph();
+        auto write = [&](const std::string &path,
+                         const std::vector<std::string> &mainFiles) {
+            std::string text =
+                amalgamate(mainFiles, graph, renamer.getRewrittenFiles());
+            if (options.stripWhitespace)
+                text = stripWhitespace(text, cxxLangOptions());
+            std::error_code ec;
+            llvm::raw_fd_ostream out(path, ec);
+            if (ec) {
+                llvm::errs() << "Failed to write " << path << ": "
+                             << ec.message() << "\n";
+                return false;
+            }
+            if (options.compression == OutputCompression::None) {
+                out << text;
+            } else {
+                FramedWriter writer(out, options.compression, &stats);
+                writer.addFrame(llvm::sys::path::filename(path), text);
+            }
+            return true;
+        };
+
+        double outputMs = 0;
+        {
+            PhaseTimer timer("Output", outputMs, outputFile);
+            if (!options.unityChunks) {
+                complete &= write(outputFile, sources);
+            } else {
+                // every chunk is written, even an empty one, so the set of
+                // files only depends on the chunk count
+                std::vector<UnityChunk> chunks = planUnityChunks(
+                    sources, stats.getTUs(), graph, options.unityChunks);
+                for (unsigned i = 0; i < chunks.size(); ++i) {
+                    if (!write(unityChunkPath(outputFile, i),
+                               chunks[i].sources)) {
+                        complete = false;
+                        break;
+                    }
+                    // the planner's estimate, next to the measured phases,
+                    // to compare with what the downstream compile takes
+                    stats.add(Stats::UnityChunkSources,
+                              chunks[i].sources.size());
+                    stats.addPhase("unityChunk" + std::to_string(i) +
+                                       "Estimate",
+                                   chunks[i].cost);
+                }
+            }
+        }
+        stats.addPhase("output", outputMs);
+        return complete ? 0 : 1;
+    }
+
+    double outputMs = 0;
+    {
+        PhaseTimer timer("Output", outputMs, outputFile);
+        std::error_code ec;
+        llvm::raw_fd_ostream out(outputFile, ec);
+        if (ec) {
+            llvm::errs() << "Failed to write " << outputFile << ": "
+                         << ec.message() << "\n";
+            return 1;
+        }
+        renamer.writeCombinedOutput(out, options.compression);
+    }
+    stats.addPhase("output", outputMs);
+    return complete ? 0 : 1;
+}
+
+// Writes the frames of a file produced with --output-compression to stdout,
+// either all of them in order or only those named `section`.
+int decompressFile(const std::string &filename, const std::string &section) {
+    auto bufferOrError = llvm::MemoryBuffer::getFile(
+        filename, /*IsText=*/false, /*RequiresNullTerminator=*/false);
+    if (!bufferOrError) {
+        llvm::errs() << "Failed to read " << filename << ": "
+                     << bufferOrError.getError().message() << "\n";
+        return 1;
+    }
+
+    llvm::StringRef file = (*bufferOrError)->getBuffer();
+    auto frames = readFrameIndex(file);
+    if (!frames)
+        return 1;
+
+    std::string text;
+    for (const FrameInfo &frame : *frames) {
+        if (!section.empty() && frame.name != section)
+            continue;
+        text.clear();
+        if (!readFrame(file, frame.offset, text))
+            return 1;
+        llvm::outs() << text;
+    }
+    return 0;
+}
+
+// true if `path` can be created or replaced
+bool isWritable(const std::string &path) {
+    if (llvm::sys::fs::exists(path))
+        return !llvm::sys::fs::access(path, llvm::sys::fs::AccessMode::Write);
+    llvm::StringRef dir = llvm::sys::path::parent_path(path);
+    return !llvm::sys::fs::access(dir.empty() ? "." : dir,
+                                  llvm::sys::fs::AccessMode::Write);
+}
+
+// The index is rebuilt from the mapping file whenever it is missing or older,
+// so callers only ever name the mapping. A mapping in a read-only place (a
+// shared --base-mapping, say) gets its index in the temp directory instead,
+// named after the mapping's path.
+std::unique_ptr<MappingIndex> openMappingIndex(const std::string &mapping,
+                                               const std::string &indexPath) {
+    llvm::sys::fs::file_status mappingStatus;
+    if (llvm::sys::fs::status(mapping, mappingStatus)) {
+        llvm::errs() << "Failed to read " << mapping << "\n";
+        return nullptr;
+    }
+    auto isCurrent = [&](const std::string &path) {
+        llvm::sys::fs::file_status indexStatus;
+        return !llvm::sys::fs::status(path, indexStatus) &&
+               indexStatus.getLastModificationTime() >=
+                   mappingStatus.getLastModificationTime();
+    };
+
+    std::string path = indexPath;
+    if (!isCurrent(path) && !isWritable(path)) {
+        llvm::SmallString<256> temp;
+        llvm::sys::path::system_temp_directory(/*ErasedOnReboot=*/true, temp);
+        std::string name = normalizedPath(mapping);
+        llvm::sys::path::append(
+            temp, "tinysea-" +
+                      llvm::utohexstr(llvm::xxh3_64bits(
+                          llvm::arrayRefFromStringRef(name))) +
+                      ".idx");
+        path = temp.str().str();
+    }
+    if (!isCurrent(path)) {
+        Renamer renamer;
+        renamer.loadMappings(mapping);
+        if (!renamer.writeMappingIndex(path))
+            return nullptr;
     }
+    return MappingIndex::open(path);
+}
+
+// `tinysea unmap`: rewrites short names in text (logs, backtraces, compiler
+// output) back to the names they replaced, or with `lookup` translates one
+// name per line in either direction.
+int runUnmap(const std::string &mapping, const std::string &indexPath,
+             const std::vector<std::string> &inputs, bool lookup, bool reverse,
+             bool reportThroughput, bool allWords) {
+    auto index = openMappingIndex(
+        mapping, indexPath.empty() ? mapping + ".idx" : indexPath);
+    if (!index)
+        return 1;
+
+    std::vector<std::string> files = inputs;
+    if (files.empty())
+        files.push_back("-");
 
-    // Run tool with proper error handling
-    clang::tooling::ClangTool tool(OptionsParser->getCompilations(),
-                                   OptionsParser->getSourcePathList());
+    Clock::time_point start = Clock::now();
+    uint64_t bytes = 0, replaced = 0;
+    for (const std::string &file : files) {
+        auto input = llvm::MemoryBuffer::getFileOrSTDIN(
+            file, /*IsText=*/false, /*RequiresNullTerminator=*/false);
+        if (!input) {
+            llvm::errs() << "Failed to read " << file << ": "
+                         << input.getError().message() << "\n";
+            return 1;
+        }
+        llvm::StringRef text = (*input)->getBuffer();
+        bytes += text.size();
 
-    auto factory = std::make_unique<CustomActionFactory>(renamer);
-    if (int result = tool.run(factory.get())) {
-        llvm::errs() << "Tool failed with code: " << result << "\n";
-        return;
+        if (!lookup) {
+            replaced += unmapText(*index, text, llvm::outs(), allWords);
+            continue;
+        }
+
+        // one name per line in, "name<TAB>translation" out; the translation
+        // is empty for names the mapping doesn't know
+        while (!text.empty()) {
+            auto [line, rest] = text.split('\n');
+            text = rest;
+            line = line.trim();
+            if (line.empty())
+                continue;
+            llvm::StringRef found =
+                reverse ? index->shortName(line) : index->original(line);
+            if (!found.empty())
+                ++replaced;
+            llvm::outs() << line << '\t' << found << '\n';
+        }
     }
+    llvm::outs().flush();
 
-    std::ofstream out(outputFile);
-    out << renamer.getCombinedOutput();
+    if (reportThroughput) {
+        double seconds =
+            std::chrono::duration<double>(Clock::now() - start).count();
+        llvm::errs() << "unmap: " << bytes << " bytes, " << replaced
+                     << " names in " << seconds * 1e3 << " ms ("
+                     << (seconds > 0 ? bytes / 1e6 / seconds : 0)
+                     << " MB/s)\n";
+    }
+    return 0;
 }
 
 int main(int argc, const char **argv) {
+    Clock::time_point startTime = Clock::now();
     llvm::InitLLVM init(argc, argv);
 
     llvm::cl::OptionCategory category("tinysea Options");
@@ -93,28 +564,423 @@ int main(int argc, const char **argv) {
     llvm::cl::opt<std::string> MappingFile(
         "mapping", llvm::cl::desc("Specify mapping file"),
         llvm::cl::value_desc("filename"), llvm::cl::cat(category));
+    llvm::cl::opt<std::string> baseMappingFile(
+        "base-mapping",
+        llvm::cl::desc("Read-only mapping shared with other projects, "
+                       "consulted after --mapping through its index"),
+        llvm::cl::value_desc("filename"), llvm::cl::cat(category));
+    llvm::cl::opt<bool> useStdin(
+        "stdin",
+        llvm::cl::desc("Rewrite a single file read from stdin to stdout"),
+        llvm::cl::cat(category));
+    llvm::cl::opt<std::string> stdinFilename(
+        "stdin-filename",
+        llvm::cl::desc("File name to use for diagnostics in --stdin mode"),
+        llvm::cl::init("stdin.cpp"), llvm::cl::cat(category));
+    // not "extra-arg": CommonOptionsParser registers that one itself
+    llvm::cl::list<std::string> extraArgs(
+        "stdin-extra-arg",
+        llvm::cl::desc("Additional compiler argument for --stdin mode"),
+        llvm::cl::cat(category));
+    llvm::cl::opt<bool> reportLatency(
+        "report-latency",
+        llvm::cl::desc("Print startup-to-first-byte latency to stderr"),
+        llvm::cl::cat(category));
+    llvm::cl::opt<std::string> statsFile(
+        "stats",
+        llvm::cl::desc("Write counters and phase timings as JSON ('-' for "
+                       "stderr)"),
+        llvm::cl::value_desc("filename"), llvm::cl::cat(category));
+    llvm::cl::opt<std::string> timeTraceFile(
+        "time-trace",
+        llvm::cl::desc("Write a Chrome trace compatible with clang's "
+                       "-ftime-trace"),
+        llvm::cl::value_desc("filename"), llvm::cl::cat(category));
+    llvm::cl::opt<unsigned> timeTraceGranularity(
+        "time-trace-granularity",
+        llvm::cl::desc("Minimum event duration in microseconds for "
+                       "--time-trace"),
+        llvm::cl::init(500), llvm::cl::cat(category));
+    llvm::cl::opt<bool> stripWhitespaceOpt(
+        "strip-whitespace",
+        llvm::cl::desc("Remove comments and redundant whitespace from the "
+                       "output"),
+        llvm::cl::cat(category));
+    llvm::cl::opt<bool> minifyLiterals(
+        "minify-literals",
+        llvm::cl::desc("Respell numeric and bool literals in their shortest "
+                       "equivalent form"),
+        llvm::cl::cat(category));
+    llvm::cl::opt<bool> deadCodeElim(
+        "dead-code-elim",
+        llvm::cl::desc("Omit declarations unreachable from main, exported "
+                       "symbols and --keep from --output"),
+        llvm::cl::cat(category));
+    llvm::cl::list<std::string> keepSymbols(
+        "keep",
+        llvm::cl::desc("Qualified name to treat as a root for "
+                       "--dead-code-elim"),
+        llvm::cl::CommaSeparated, llvm::cl::cat(category));
+    llvm::cl::opt<std::string> deadCodeReport(
+        "dce-report",
+        llvm::cl::desc("Write the list of dropped declarations here instead "
+                       "of stderr"),
+        llvm::cl::value_desc("filename"), llvm::cl::cat(category));
+    llvm::cl::opt<bool> amalgamateOpt(
+        "amalgamate",
+        llvm::cl::desc("Write --output as a single self-contained translation "
+                       "unit with project headers inlined"),
+        llvm::cl::cat(category));
+    llvm::cl::opt<unsigned> unityChunks(
+        "unity-chunks",
+        llvm::cl::desc("Write --amalgamate output as this many translation "
+                       "units balanced by parse time (0 = one file)"),
+        llvm::cl::init(0), llvm::cl::cat(category));
+    llvm::cl::opt<OutputCompression> compression(
+        "output-compression",
+        llvm::cl::desc("Compress --output and the mapping file into "
+                       "independently decompressible frames"),
+        llvm::cl::values(
+            clEnumValN(OutputCompression::None, "none", "No compression"),
+            clEnumValN(OutputCompression::Zlib, "zlib", "zlib"),
+            clEnumValN(OutputCompression::Zstd, "zstd", "Zstandard")),
+        llvm::cl::init(OutputCompression::None), llvm::cl::cat(category));
+    llvm::cl::opt<std::string> decompress(
+        "decompress",
+        llvm::cl::desc("Write the contents of a compressed --output or "
+                       "mapping file to stdout"),
+        llvm::cl::value_desc("filename"), llvm::cl::cat(category));
+    llvm::cl::opt<std::string> section(
+        "section",
+        llvm::cl::desc("With --decompress, only write the frames with this "
+                       "name"),
+        llvm::cl::cat(category));
+    llvm::cl::opt<NamingStrategy> naming(
+        "naming", llvm::cl::desc("Order in which short names are assigned"),
+        llvm::cl::values(
+            clEnumValN(NamingStrategy::Sequential, "sequential",
+                       "a, b, ..., z, ba, ... in order of first use"),
+            clEnumValN(NamingStrategy::Cooccurrence, "cooccurrence",
+                       "Frequency-ordered letters, with names first used "
+                       "together sharing a prefix")),
+        llvm::cl::init(NamingStrategy::Sequential), llvm::cl::cat(category));
+    llvm::cl::opt<bool> verify(
+        "verify",
+        llvm::cl::desc("Syntax-check the rewritten sources in memory and "
+                       "report any that no longer compile"),
+        llvm::cl::cat(category));
+    llvm::cl::list<std::string> changedFiles(
+        "changed-files",
+        llvm::cl::desc("Only process translation units that include one of "
+                       "these files"),
+        llvm::cl::CommaSeparated, llvm::cl::cat(category));
+    llvm::cl::opt<std::string> depsCache(
+        "deps-cache",
+        llvm::cl::desc("Include closure cache for --changed-files (default: "
+                       "<cmake-project>/tinysea-deps.json); given on its "
+                       "own, keeps it current and pre-scans the closures"),
+        llvm::cl::value_desc("filename"), llvm::cl::cat(category));
+    llvm::cl::opt<bool> listAffected(
+        "list-affected",
+        llvm::cl::desc("Print the selected translation units and their "
+                       "closure keys instead of processing them"),
+        llvm::cl::cat(category));
+    llvm::cl::opt<std::string> policyFile(
+        "policy",
+        llvm::cl::desc("Rules for which names to keep, on top of the "
+                       "built-in ones"),
+        llvm::cl::value_desc("filename"), llvm::cl::cat(category));
+    llvm::cl::opt<bool> guardExternalNames(
+        "guard-external-names",
+        llvm::cl::desc("Never generate a short name that a system header "
+                       "or a header outside the project spells (default: "
+                       "true)"),
+        llvm::cl::init(true), llvm::cl::cat(category));
+    llvm::cl::opt<std::string> projectRoot(
+        "project-root",
+        llvm::cl::desc("Headers outside this directory count as external "
+                       "(default: the directory holding every source and "
+                       "build directory)"),
+        llvm::cl::value_desc("dir"), llvm::cl::cat(category));
+    llvm::cl::opt<bool> sharedFileCache(
+        "shared-file-cache",
+        llvm::cl::desc("Cache stat results, directory listings and file "
+                       "contents across all translation units"),
+        llvm::cl::cat(category));
+    llvm::cl::opt<unsigned> prefetch(
+        "prefetch",
+        llvm::cl::desc("Read the include closures of this many upcoming "
+                       "translation units into the page cache ahead of "
+                       "parsing (0 = off)"),
+        llvm::cl::init(0), llvm::cl::cat(category));
+    llvm::cl::opt<bool> asyncWrites(
+        "async-writes",
+        llvm::cl::desc("Write rewritten files on a background thread"),
+        llvm::cl::cat(category));
+    llvm::cl::opt<unsigned> pipelineDepth(
+        "pipeline-depth",
+        llvm::cl::desc("Serialize and write output on separate stages, "
+                       "queueing at most this many items per stage "
+                       "(0 = off)"),
+        llvm::cl::init(0), llvm::cl::cat(category));
+    llvm::cl::opt<unsigned> serializeJobs(
+        "serialize-jobs",
+        llvm::cl::desc("Threads in the serialize stage of --pipeline-depth"),
+        llvm::cl::init(1), llvm::cl::cat(category));
+    llvm::cl::opt<std::string> shard(
+        "shard",
+        llvm::cl::desc("Only process shard i of N of the project, writing "
+                       "placeholder names for merge-mappings"),
+        llvm::cl::value_desc("i/N"), llvm::cl::cat(category));
+    llvm::cl::opt<bool> gcMappings(
+        "gc-mappings",
+        llvm::cl::desc("Drop mapping entries this run didn't use and move "
+                       "the most used names onto shorter free ones"),
+        llvm::cl::cat(category));
+    llvm::cl::opt<unsigned> gcGraceRuns(
+        "gc-grace-runs",
+        llvm::cl::desc("With --gc-mappings, keep unused entries for this "
+                       "many more runs"),
+        llvm::cl::init(0), llvm::cl::cat(category));
+    llvm::cl::opt<unsigned> gcMaxMoves(
+        "gc-max-moves",
+        llvm::cl::desc("With --gc-mappings, rename at most this many entries "
+                       "per run (0 = never)"),
+        llvm::cl::init(64), llvm::cl::cat(category));
+    llvm::cl::opt<unsigned> jobs(
+        "j",
+        llvm::cl::desc("Number of translation units to process in parallel "
+                       "(0 = all cores)"),
+        llvm::cl::init(1), llvm::cl::cat(category));
+
+    llvm::cl::SubCommand unmap(
+        "unmap", "Translate short names in text back to the original names");
+    llvm::cl::opt<std::string> unmapMapping(
+        "mapping", llvm::cl::desc("Mapping file to translate with"),
+        llvm::cl::value_desc("filename"), llvm::cl::Required,
+        llvm::cl::sub(unmap), llvm::cl::cat(category));
+    llvm::cl::opt<std::string> unmapIndex(
+        "index",
+        llvm::cl::desc("Index file, rebuilt when older than the mapping "
+                       "(default: <mapping>.idx)"),
+        llvm::cl::value_desc("filename"), llvm::cl::sub(unmap),
+        llvm::cl::cat(category));
+    llvm::cl::opt<bool> unmapLookup(
+        "lookup",
+        llvm::cl::desc("Translate one name per input line instead of "
+                       "rewriting text"),
+        llvm::cl::sub(unmap), llvm::cl::cat(category));
+    llvm::cl::opt<bool> unmapReverse(
+        "reverse",
+        llvm::cl::desc("With --lookup, translate original names to short "
+                       "names"),
+        llvm::cl::sub(unmap), llvm::cl::cat(category));
+    llvm::cl::opt<bool> unmapReport(
+        "report-throughput",
+        llvm::cl::desc("Print bytes processed and MB/s to stderr"),
+        llvm::cl::sub(unmap), llvm::cl::cat(category));
+    llvm::cl::opt<bool> unmapAllWords(
+        "all-words",
+        llvm::cl::desc("Replace every word that is a short name, not only "
+                       "quoted names, calls and :: paths"),
+        llvm::cl::sub(unmap), llvm::cl::cat(category));
+    llvm::cl::list<std::string> unmapInputs(
+        llvm::cl::Positional, llvm::cl::desc("[<file> ...]"),
+        llvm::cl::sub(unmap), llvm::cl::cat(category));
+
+    llvm::cl::SubCommand mergeMappingsCmd(
+        "merge-mappings",
+        "Combine --shard mapping files and replace the placeholders");
+    llvm::cl::list<std::string> mergeInputs(
+        llvm::cl::Positional, llvm::cl::desc("<shard mapping> ..."),
+        llvm::cl::OneOrMore, llvm::cl::sub(mergeMappingsCmd),
+        llvm::cl::cat(category));
+    llvm::cl::opt<std::string> mergeBase(
+        "base",
+        llvm::cl::desc("Mapping file the shards were given with --mapping"),
+        llvm::cl::value_desc("filename"), llvm::cl::sub(mergeMappingsCmd),
+        llvm::cl::cat(category));
+    llvm::cl::opt<std::string> mergeOutput(
+        "output", llvm::cl::desc("Merged mapping file to write"),
+        llvm::cl::value_desc("filename"), llvm::cl::Required,
+        llvm::cl::sub(mergeMappingsCmd), llvm::cl::cat(category));
+    llvm::cl::list<std::string> mergeRewrite(
+        "rewrite",
+        llvm::cl::desc("Shard output files to replace placeholders in"),
+        llvm::cl::CommaSeparated, llvm::cl::sub(mergeMappingsCmd),
+        llvm::cl::cat(category));
+    llvm::cl::opt<unsigned> mergeJobs(
+        "j",
+        llvm::cl::desc("Number of files to rewrite in parallel (0 = all "
+                       "cores)"),
+        llvm::cl::init(0), llvm::cl::sub(mergeMappingsCmd),
+        llvm::cl::cat(category));
 
     llvm::cl::HideUnrelatedOptions(category);
     llvm::cl::ParseCommandLineOptions(argc, argv, "tinysea\n");
 
+    if (unmap) {
+        return runUnmap(unmapMapping, unmapIndex, unmapInputs, unmapLookup,
+                        unmapReverse, unmapReport, unmapAllWords);
+    }
+
+    if (mergeMappingsCmd) {
+        return mergeMappings(mergeInputs, mergeBase, mergeOutput,
+                             mergeRewrite, mergeJobs);
+    }
+
+    if (!decompress.empty())
+        return decompressFile(decompress, section);
+
+    if (const char *reason = compressionUnsupportedReason(compression)) {
+        llvm::errs() << "--output-compression unavailable: " << reason << "\n";
+        return 1;
+    }
+
+    if (!timeTraceFile.empty())
+        llvm::timeTraceProfilerInitialize(timeTraceGranularity, argv[0]);
+
+    std::optional<ShardSpec> shardSpec;
+    if (!shard.empty()) {
+        shardSpec = ShardSpec::parse(shard);
+        if (!shardSpec)
+            return 1;
+    }
+
+    // only a full run sees every name that is still in use
+    if (gcMappings && (MappingFile.empty() || cmakeProject.empty() ||
+                       !changedFiles.empty() || shardSpec)) {
+        llvm::errs() << "--gc-mappings needs --mapping and a full "
+                        "--cmake-project run without --changed-files or "
+                        "--shard\n";
+        return 1;
+    }
+
+    // these outputs are built from every translation unit's rewrite, and
+    // --changed-files only parses the affected ones
+    if (!changedFiles.empty() &&
+        (amalgamateOpt || unityChunks || deadCodeElim)) {
+        llvm::errs() << "--changed-files can't be combined with "
+                        "--amalgamate, --unity-chunks or --dead-code-elim, "
+                        "which need the whole project\n";
+        return 1;
+    }
+
+    // names are handed out in the order workers first reach them, so a
+    // parallel run would save a different mapping each time; a shard's
+    // placeholders are renamed in sorted order by merge-mappings instead
+    if (!MappingFile.empty() && jobs != 1 && !shardSpec) {
+        llvm::errs() << "--mapping needs -j=1 (or --shard and "
+                        "merge-mappings) for a reproducible mapping\n";
+        return 1;
+    }
+
     Renamer renamer;
+    renamer.setNamingStrategy(naming);
+    if (gcMappings)
+        renamer.setGarbageCollection({gcGraceRuns, gcMaxMoves});
+    if (shardSpec)
+        renamer.setPlaceholderPrefix(shardSpec->placeholderPrefix());
+    if (!policyFile.empty()) {
+        std::optional<NamePolicy> policy = NamePolicy::load(policyFile);
+        if (!policy)
+            return 1;
+        renamer.setPolicy(std::move(*policy));
+    }
 
+    if (!baseMappingFile.empty()) {
+        auto base = openMappingIndex(baseMappingFile, baseMappingFile + ".idx");
+        if (!base)
+            return 1;
+        renamer.setBaseMapping(std::move(base));
+    }
     if (!MappingFile.empty())
         renamer.loadMappings(MappingFile);
 
-    if (cmakeProject.empty())
+    ToolOptions options;
+    options.jobs = jobs ? jobs.getValue()
+                        : llvm::hardware_concurrency().compute_thread_count();
+    options.stripWhitespace = stripWhitespaceOpt;
+    options.minifyLiterals = minifyLiterals;
+    options.deadCodeElimination = deadCodeElim;
+    options.keepSymbols = keepSymbols;
+    options.deadCodeReport = deadCodeReport;
+    options.amalgamate = amalgamateOpt || unityChunks;
+    options.unityChunks = unityChunks;
+    options.compression = compression;
+    options.verify = verify;
+    options.changedFiles = changedFiles;
+    options.depsCache = depsCache;
+    options.listAffected = listAffected;
+    options.guardExternalNames = guardExternalNames;
+    if (!projectRoot.empty()) {
+        options.projectRoot = normalizedPath(projectRoot);
+        if (!llvm::StringRef(options.projectRoot).ends_with("/"))
+            options.projectRoot += '/';
+    }
+    options.sharedFileCache = sharedFileCache;
+    options.prefetch = prefetch;
+    options.asyncWrites = asyncWrites;
+    options.pipelineDepth = pipelineDepth;
+    options.serializeJobs = serializeJobs;
+    options.shard = shardSpec;
+    if (options.amalgamate)
+        options.inMemoryOutput = true;
+    if (!timeTraceFile.empty())
+        options.timeTraceGranularity = timeTraceGranularity;
+    int result = 0;
+    int projectResult = 0;
+
+    if (useStdin) {
+        options.inMemoryOutput = true;
+        result = processStdin(stdinFilename, extraArgs, renamer, options,
+                              startTime, reportLatency);
+    } else if (!cmakeProject.empty()) {
+        projectResult = processCMakeProject(cmakeProject, outputFile, renamer,
+                                            options, category);
+    } else {
         return 1;
+    }
+
+    // Only save if there are mappings and a filename was specified. A
+    // failed project run still saves, since the files it did rewrite are on
+    // disk, but doesn't collect garbage: names from the TUs that failed went
+    // unseen.
+    if (result == 0 && !MappingFile.empty() && renamer.hasMappings()) {
+        if (gcMappings && projectResult == 0)
+            renamer.collectGarbage();
+        renamer.saveMappings(MappingFile, options.compression);
+    }
 
-    processCMakeProject(cmakeProject, outputFile, renamer, category);
+    if (!statsFile.empty()) {
+        if (statsFile == "-") {
+            renamer.getStats().writeJSON(llvm::errs());
+        } else {
+            std::error_code ec;
+            llvm::raw_fd_ostream out(statsFile, ec);
+            if (ec) {
+                llvm::errs() << "Failed to write stats: " << ec.message()
+                             << "\n";
+            } else {
+                renamer.getStats().writeJSON(out);
+            }
+        }
+    }
 
-    std::cout << "in here" << std::endl;
+    // mappings are still saved above: the rewritten files are already on
+    // disk and have to stay consistent with them
+    if (renamer.getStats().get(Stats::VerifyRegressions) || projectResult)
+        result = 1;
 
-    // Only save if there are mappings and a filename was specified
-    if (!MappingFile.empty() && renamer.hasMappings()) {
-        renamer.saveMappings(MappingFile);
+    if (llvm::timeTraceProfilerEnabled()) {
+        if (auto err = llvm::timeTraceProfilerWrite(timeTraceFile, "")) {
+            llvm::errs() << "Failed to write time trace: "
+                         << llvm::toString(std::move(err)) << "\n";
+        }
+        llvm::timeTraceProfilerCleanup();
     }
 
-    return 0;
+    return result;
 }
 /*
     auto ExpectedParser =
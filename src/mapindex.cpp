@@ -0,0 +1,229 @@
+#include "stdafx.h"
+
+using namespace llvm::support;
+
+static constexpr llvm::StringLiteral indexMagic = "TSMI";
+static constexpr uint32_t indexVersion = 2;
+// version 1 headers stop before nameEnd
+static constexpr size_t indexHeaderSize = 32;
+static constexpr size_t v1HeaderSize = 28;
+static constexpr size_t entrySize = 16;
+
+static uint64_t hashName(llvm::StringRef name) {
+    return llvm::xxh3_64bits(llvm::arrayRefFromStringRef(name));
+}
+
+bool MappingIndex::write(
+    const std::unordered_map<std::string, std::string> &map,
+    const std::string &path, uint32_t nameEnd) {
+    // sorted so the same mapping always produces the same file
+    std::vector<const std::pair<const std::string, std::string> *> sorted;
+    sorted.reserve(map.size());
+    for (const auto &pair : map)
+        sorted.push_back(&pair);
+    llvm::sort(sorted, [](auto *a, auto *b) { return a->first < b->first; });
+
+    uint32_t tableSize =
+        std::max<uint32_t>(16, llvm::NextPowerOf2(sorted.size() * 2));
+    std::vector<uint32_t> byShort(tableSize, 0), byKey(tableSize, 0);
+    auto insert = [&](std::vector<uint32_t> &table, llvm::StringRef name,
+                      uint32_t entry) {
+        uint64_t slot = hashName(name) & (tableSize - 1);
+        while (table[slot])
+            slot = (slot + 1) & (tableSize - 1);
+        table[slot] = entry + 1;
+    };
+
+    uint64_t poolSize = 0;
+    uint32_t maxShort = 0;
+    for (uint32_t i = 0; i < sorted.size(); ++i) {
+        const auto &[key, shortName] = *sorted[i];
+        insert(byKey, key, i);
+        insert(byShort, shortName, i);
+        poolSize += key.size() + shortName.size();
+        maxShort = std::max<uint32_t>(maxShort, shortName.size());
+    }
+    if (poolSize > UINT32_MAX) {
+        llvm::errs() << "Mapping too large to index\n";
+        return false;
+    }
+
+    auto err = llvm::writeToOutput(path, [&](llvm::raw_ostream &os) {
+        endian::Writer writer(os, llvm::endianness::little);
+        os << indexMagic;
+        writer.write<uint32_t>(indexVersion);
+        writer.write<uint32_t>(sorted.size());
+        writer.write<uint32_t>(tableSize);
+        writer.write<uint32_t>(maxShort);
+        writer.write<uint64_t>(poolSize);
+        writer.write<uint32_t>(nameEnd);
+
+        uint32_t offset = 0;
+        for (const auto *pair : sorted) {
+            writer.write<uint32_t>(offset);
+            writer.write<uint32_t>(pair->first.size());
+            offset += pair->first.size();
+            writer.write<uint32_t>(offset);
+            writer.write<uint32_t>(pair->second.size());
+            offset += pair->second.size();
+        }
+        for (uint32_t slot : byShort)
+            writer.write<uint32_t>(slot);
+        for (uint32_t slot : byKey)
+            writer.write<uint32_t>(slot);
+        for (const auto *pair : sorted)
+            os << pair->first << pair->second;
+        return llvm::Error::success();
+    });
+    if (err) {
+        llvm::errs() << "Failed to write " << path << ": "
+                     << llvm::toString(std::move(err)) << "\n";
+        return false;
+    }
+    return true;
+}
+
+std::unique_ptr<MappingIndex> MappingIndex::open(const std::string &path) {
+    auto bufferOrError = llvm::MemoryBuffer::getFile(
+        path, /*IsText=*/false, /*RequiresNullTerminator=*/false);
+    if (!bufferOrError) {
+        llvm::errs() << "Failed to read " << path << ": "
+                     << bufferOrError.getError().message() << "\n";
+        return nullptr;
+    }
+
+    llvm::StringRef data = (*bufferOrError)->getBuffer();
+    auto malformed = [&] {
+        llvm::errs() << path << " is not a tinysea mapping index\n";
+        return nullptr;
+    };
+    if (data.size() < v1HeaderSize || !data.starts_with(indexMagic))
+        return malformed();
+    uint32_t version = endian::read32le(data.data() + 4);
+    size_t headerSize = version == 1 ? v1HeaderSize : indexHeaderSize;
+    if ((version != 1 && version != indexVersion) || data.size() < headerSize)
+        return malformed();
+
+    std::unique_ptr<MappingIndex> index(new MappingIndex());
+    index->count = endian::read32le(data.data() + 8);
+    index->tableSize = endian::read32le(data.data() + 12);
+    index->maxShort = endian::read32le(data.data() + 16);
+    uint64_t poolSize = endian::read64le(data.data() + 20);
+    if (version != 1)
+        index->end = endian::read32le(data.data() + 28);
+
+    uint64_t entriesSize = uint64_t(index->count) * entrySize;
+    uint64_t tableBytes = uint64_t(index->tableSize) * 4;
+    if (!llvm::isPowerOf2_32(index->tableSize) ||
+        uint64_t(index->count) * 2 > index->tableSize ||
+        data.size() != headerSize + entriesSize + 2 * tableBytes + poolSize)
+        return malformed();
+
+    index->entries = data.data() + headerSize;
+    index->byShort = index->entries + entriesSize;
+    index->byKey = index->byShort + tableBytes;
+    index->pool = data.take_back(poolSize);
+    index->buffer = std::move(*bufferOrError);
+    return index;
+}
+
+llvm::StringRef MappingIndex::poolString(uint32_t offset, uint32_t size) const {
+    // a damaged entry reads as a miss rather than past the end of the file
+    if (uint64_t(offset) + size > pool.size())
+        return "";
+    return pool.substr(offset, size);
+}
+
+llvm::StringRef MappingIndex::find(const char *table, llvm::StringRef name,
+                                   bool byShortName) const {
+    if (!count)
+        return "";
+
+    uint32_t mask = tableSize - 1;
+    for (uint64_t slot = hashName(name) & mask;;
+         slot = (slot + 1) & mask) {
+        uint32_t entry = endian::read32le(table + slot * 4);
+        if (!entry || entry > count)
+            return "";
+
+        const char *fields = entries + uint64_t(entry - 1) * entrySize;
+        llvm::StringRef key = poolString(endian::read32le(fields),
+                                         endian::read32le(fields + 4));
+        llvm::StringRef shortName = poolString(endian::read32le(fields + 8),
+                                               endian::read32le(fields + 12));
+        if ((byShortName ? shortName : key) == name)
+            return byShortName ? key : shortName;
+    }
+}
+
+llvm::StringRef MappingIndex::original(llvm::StringRef shortName) const {
+    if (shortName.size() > maxShort)
+        return "";
+    return find(byShort, shortName, /*byShortName=*/true);
+}
+
+llvm::StringRef MappingIndex::shortName(llvm::StringRef key) const {
+    return find(byKey, key, /*byShortName=*/false);
+}
+
+// how compilers, debuggers and sanitizers show a symbol: 'name', `name' or
+// GCC's UTF-8 quotes in diagnostics, name( in frames and signatures, and
+// a::b paths
+static bool isSymbolContext(llvm::StringRef input, size_t start, size_t end) {
+    llvm::StringRef before = input.substr(0, start);
+    llvm::StringRef after = input.substr(end);
+    if ((before.ends_with("'") || before.ends_with("`")) &&
+        after.starts_with("'"))
+        return true;
+    if (before.ends_with("\xE2\x80\x98") &&
+        after.starts_with("\xE2\x80\x99"))
+        return true;
+    if (before.ends_with("::") || after.starts_with("::"))
+        return true;
+    size_t next = input.find_first_not_of(" \t", end);
+    return next != llvm::StringRef::npos && input[next] == '(';
+}
+
+uint64_t unmapText(const MappingIndex &index, llvm::StringRef input,
+                   llvm::raw_ostream &out, bool allWords) {
+    uint64_t replaced = 0;
+    size_t copied = 0;
+    size_t pos = 0;
+
+    while (pos != input.size()) {
+        char c = input[pos];
+        // a number, hex and suffixes included, so 0xab never yields "xab"
+        if (llvm::isDigit(c)) {
+            while (pos != input.size() &&
+                   (clang::isAsciiIdentifierContinue(input[pos]) ||
+                    input[pos] == '.' || input[pos] == '\''))
+                ++pos;
+            continue;
+        }
+        if (!clang::isAsciiIdentifierStart(c)) {
+            ++pos;
+            continue;
+        }
+        size_t start = pos;
+        while (pos != input.size() &&
+               clang::isAsciiIdentifierContinue(input[pos]))
+            ++pos;
+
+        // most tokens in a log are longer than any short name
+        if (pos - start > index.maxShortSize())
+            continue;
+        if (!allWords && !isSymbolContext(input, start, pos))
+            continue;
+        llvm::StringRef original = index.original(input.slice(start, pos));
+        if (original.empty())
+            continue;
+
+        out << input.slice(copied, start);
+        original.consume_front("#");
+        out << original;
+        copied = pos;
+        ++replaced;
+    }
+    out << input.drop_front(copied);
+    return replaced;
+}
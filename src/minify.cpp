@@ -0,0 +1,97 @@
+#include "stdafx.h"
+
+using namespace clang;
+
+static bool isIdentifierChar(char c) {
+    return isAsciiIdentifierContinue(c) || c == '$';
+}
+
+// true if writing `next` straight after `prev` could lex differently, e.g. two
+// identifiers merging, `+ +` turning into `++`, or `/ /` into a comment
+static bool needsSpace(const Token &prevTok, llvm::StringRef prev,
+                       llvm::StringRef next) {
+    char a = prev.back();
+    char b = next.front();
+
+    if (isIdentifierChar(a) && isIdentifierChar(b))
+        return true;
+
+    // pp-numbers swallow `.`, `+` and `-` (think `1e` `+1`)
+    if (prevTok.is(tok::numeric_constant) &&
+        (b == '.' || b == '+' || b == '-'))
+        return true;
+    if (a == '.' && isDigit(b))
+        return true;
+
+    // encoding prefixes and user-defined literal suffixes
+    if (isIdentifierChar(a) && (b == '"' || b == '\''))
+        return true;
+    if ((a == '"' || a == '\'') && isIdentifierChar(b))
+        return true;
+
+    static const llvm::StringRef joined[] = {
+        "++", "--", "+=", "-=", "->", "<<", ">>", "<=", ">=", "==", "!=",
+        "&&", "||", "&=", "|=", "^=", "*=", "/=", "%=", "::", "##", "//",
+        "/*", "..", ".*", "<:", "<%", "%:", ":>", "%>", "%="};
+    char pair[2] = {a, b};
+    for (llvm::StringRef op : joined) {
+        if (op == llvm::StringRef(pair, 2))
+            return true;
+    }
+    return false;
+}
+
+std::string stripWhitespace(const std::string &code,
+                            const LangOptions &langOpts) {
+    std::string out;
+    out.reserve(code.size());
+
+    // raw mode: no preprocessor, no source manager, comments are skipped
+    const char *begin = code.c_str();
+    Lexer lexer(SourceLocation(), langOpts, begin, begin, begin + code.size());
+
+    Token tok;
+    Token prevTok;
+    llvm::StringRef prev;
+    bool inDirective = false;
+
+    while (true) {
+        lexer.LexFromRawLexer(tok);
+        if (tok.is(tok::eof))
+            break;
+
+        const char *end = lexer.getBufferLocation();
+        llvm::StringRef spelling(end - tok.getLength(), tok.getLength());
+
+        if (tok.isAtStartOfLine()) {
+            bool startsDirective = tok.is(tok::hash);
+            // directives begin and end on their own lines
+            if (!out.empty() && (inDirective || startsDirective))
+                out.push_back('\n');
+            else if (!prev.empty() && needsSpace(prevTok, prev, spelling))
+                out.push_back(' ');
+            inDirective = startsDirective;
+        } else if (!prev.empty()) {
+            if (inDirective ? tok.hasLeadingSpace()
+                            : needsSpace(prevTok, prev, spelling))
+                out.push_back(' ');
+        }
+
+        out.append(spelling.begin(), spelling.end());
+        prevTok = tok;
+        prev = spelling;
+    }
+
+    if (!out.empty())
+        out.push_back('\n');
+    return out;
+}
+
+LangOptions cxxLangOptions() {
+    LangOptions langOpts;
+    langOpts.CPlusPlus = langOpts.CPlusPlus11 = langOpts.CPlusPlus14 = 1;
+    langOpts.CPlusPlus17 = langOpts.CPlusPlus20 = 1;
+    langOpts.LineComment = langOpts.Bool = langOpts.Digraphs = 1;
+    langOpts.RawStringLiterals = 1;
+    return langOpts;
+}
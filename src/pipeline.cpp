@@ -0,0 +1,89 @@
+#include "stdafx.h"
+
+static uint64_t usSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+               std::chrono::steady_clock::now() - start)
+        .count();
+}
+
+bool serializeRewrittenFile(Renamer &renamer, const ToolOptions &options,
+                            const clang::LangOptions &langOpts,
+                            RewrittenFile &file) {
+    // amalgamation splices by line number, so it strips afterwards
+    if (options.stripWhitespace && !options.amalgamate)
+        file.content = stripWhitespace(file.content, langOpts);
+    if (options.verify) {
+        renamer.collectVerifyBuffer(normalizedPath(file.path),
+                                    {std::move(file.original), file.content});
+    }
+
+    if (options.inMemoryOutput || file.header) {
+        renamer.collectRewrittenFile(options.amalgamate || file.header
+                                         ? normalizedPath(file.path)
+                                         : file.path,
+                                     file.content);
+        return false;
+    }
+    return true;
+}
+
+OutputPipeline::OutputPipeline(Renamer &renamer, const ToolOptions &options,
+                               size_t depth, unsigned serializeJobs)
+    : renamer(renamer), options(options), serializeQueue(depth),
+      writeQueue(depth) {
+    for (unsigned i = 0; i < std::max(serializeJobs, 1u); ++i)
+        serializers.emplace_back([this] { serialize(); });
+    writer = std::thread([this] { write(); });
+}
+
+OutputPipeline::~OutputPipeline() { finish(); }
+
+void OutputPipeline::submit(RewrittenTU tu) {
+    serializeQueue.push(std::move(tu));
+}
+
+void OutputPipeline::serialize() {
+    while (std::optional<RewrittenTU> tu = serializeQueue.pop()) {
+        auto start = std::chrono::steady_clock::now();
+        for (RewrittenFile &file : tu->files) {
+            if (serializeRewrittenFile(renamer, options, tu->langOpts, file))
+                writeQueue.push(std::move(file));
+        }
+        serializeBusyUs += usSince(start);
+    }
+}
+
+void OutputPipeline::write() {
+    while (std::optional<RewrittenFile> file = writeQueue.pop()) {
+        auto start = std::chrono::steady_clock::now();
+        writeFile(file->path, file->content, options.fileCache);
+        writeBusyUs += usSince(start);
+    }
+}
+
+void OutputPipeline::finish() {
+    if (finished)
+        return;
+    finished = true;
+
+    // each stage is closed once everything feeding it has stopped
+    serializeQueue.close();
+    for (std::thread &thread : serializers)
+        thread.join();
+    writeQueue.close();
+    writer.join();
+
+    Stats::StageStats serializeStage;
+    serializeStage.name = "serialize";
+    serializeStage.workers = serializers.size();
+    serializeQueue.report(serializeStage);
+    serializeStage.busyMs = serializeBusyUs / 1e3;
+    renamer.getStats().addStage(std::move(serializeStage));
+
+    Stats::StageStats writeStage;
+    writeStage.name = "write";
+    writeStage.workers = 1;
+    writeQueue.report(writeStage);
+    writeStage.busyMs = writeBusyUs / 1e3;
+    renamer.getStats().addStage(std::move(writeStage));
+}
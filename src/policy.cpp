@@ -0,0 +1,289 @@
+#include "stdafx.h"
+
+using namespace clang;
+
+static constexpr llvm::StringLiteral builtinRules = R"(
+keep namespace std
+keep name main
+keep name int
+keep name char
+keep name void
+keep name bool
+keep name float
+keep name double
+keep name ptrdiff_t
+keep name size_t
+keep name nullptr_t
+keep name max_align_t
+keep name NULL
+keep kind=function regex (^|::)(begin|end|swap|get)$
+)";
+
+SymbolFacts SymbolFacts::of(const NamedDecl *decl) {
+    SymbolFacts facts;
+    facts.qualifiedName = decl->getQualifiedNameAsString();
+    facts.externallyVisible = decl->isExternallyVisible();
+    for (const auto *annotate : decl->specific_attrs<AnnotateAttr>())
+        facts.annotations.push_back(annotate->getAnnotation().str());
+
+    // templates are classified by what they declare
+    if (const auto *tmpl = dyn_cast<TemplateDecl>(decl))
+        if (const NamedDecl *templated = tmpl->getTemplatedDecl())
+            decl = templated;
+
+    if (const auto *function = dyn_cast<FunctionDecl>(decl)) {
+        facts.kind = isa<CXXMethodDecl>(function) ? Method : Function;
+        facts.externC = function->isExternC();
+    } else if (isa<FieldDecl>(decl)) {
+        facts.kind = Field;
+    } else if (const auto *var = dyn_cast<VarDecl>(decl)) {
+        facts.kind = isa<ParmVarDecl>(var) ? Parameter : Variable;
+        facts.externC = var->isExternC();
+    } else if (isa<EnumDecl>(decl)) {
+        facts.kind = Enum;
+    } else if (isa<RecordDecl>(decl)) {
+        facts.kind = Record;
+    } else if (isa<EnumConstantDecl>(decl)) {
+        facts.kind = Enumerator;
+    } else if (isa<TypedefNameDecl>(decl)) {
+        facts.kind = Typedef;
+    } else if (isa<NamespaceDecl>(decl)) {
+        facts.kind = Namespace;
+    }
+    return facts;
+}
+
+std::string SymbolFacts::key() const {
+    std::string key = qualifiedName;
+    key += '\0';
+    key += std::to_string(kind);
+    key += externC ? 'C' : '-';
+    key += externallyVisible ? 'E' : '-';
+    for (const std::string &annotation : annotations) {
+        key += '\0';
+        key += annotation;
+    }
+    return key;
+}
+
+void NamePolicy::Trie::insert(llvm::StringRef name, bool subtree) {
+    unsigned node = 0;
+    while (!name.empty()) {
+        auto [component, rest] = name.split("::");
+        auto [it, inserted] =
+            nodes[node].children.try_emplace(component, nodes.size());
+        node = it->second;
+        if (inserted)
+            nodes.emplace_back();
+        name = rest;
+    }
+    (subtree ? nodes[node].subtree : nodes[node].exact) = true;
+}
+
+bool NamePolicy::Trie::matches(llvm::StringRef name) const {
+    unsigned node = 0;
+    while (!name.empty()) {
+        auto [component, rest] = name.split("::");
+        auto it = nodes[node].children.find(component);
+        if (it == nodes[node].children.end())
+            return false;
+        node = it->second;
+        if (nodes[node].subtree)
+            return true;
+        name = rest;
+    }
+    return nodes[node].exact;
+}
+
+bool NamePolicy::RuleGroup::matches(const SymbolFacts &facts) const {
+    if (!(kinds & facts.kind))
+        return false;
+    if (linkage == "c" && !facts.externC)
+        return false;
+    if (linkage == "internal" && facts.externallyVisible)
+        return false;
+    if (linkage == "external" && !facts.externallyVisible)
+        return false;
+    if (!annotation.empty() &&
+        !llvm::is_contained(facts.annotations, annotation))
+        return false;
+    return anyName || names.matches(facts.qualifiedName) ||
+           (regex && regex->match(facts.qualifiedName));
+}
+
+static std::optional<unsigned> parseKinds(llvm::StringRef list) {
+    unsigned kinds = 0;
+    llvm::SmallVector<llvm::StringRef, 4> names;
+    list.split(names, ',');
+    for (llvm::StringRef name : names) {
+        unsigned kind = llvm::StringSwitch<unsigned>(name)
+                            .Case("function", SymbolFacts::Function)
+                            .Case("method", SymbolFacts::Method)
+                            .Case("variable", SymbolFacts::Variable)
+                            .Case("field", SymbolFacts::Field)
+                            .Case("parameter", SymbolFacts::Parameter)
+                            .Case("record", SymbolFacts::Record)
+                            .Case("enum", SymbolFacts::Enum)
+                            .Case("enumerator", SymbolFacts::Enumerator)
+                            .Case("typedef", SymbolFacts::Typedef)
+                            .Case("namespace", SymbolFacts::Namespace)
+                            .Default(0);
+        if (!kind)
+            return std::nullopt;
+        kinds |= kind;
+    }
+    return kinds;
+}
+
+// only * and ? are wildcards; everything else, brackets included, matches
+// itself
+static std::string globToRegex(llvm::StringRef glob) {
+    std::string regex = "^";
+    for (char c : glob) {
+        if (c == '*')
+            regex += ".*";
+        else if (c == '?')
+            regex += '.';
+        else if (llvm::StringRef(".[]^$+(){}|\\").contains(c))
+            regex += std::string("\\") + c;
+        else
+            regex += c;
+    }
+    return regex + "$";
+}
+
+bool NamePolicy::addRule(llvm::StringRef line, std::string &error) {
+    auto [action, rest] = line.trim().split(' ');
+    if (action != "keep" && action != "rename") {
+        error = "expected 'keep' or 'rename'";
+        return false;
+    }
+
+    RuleGroup predicates;
+    rest = rest.ltrim();
+    while (!rest.empty()) {
+        auto [word, tail] = rest.split(' ');
+        auto [key, value] = word.split('=');
+        if (key == "kind" && !value.empty()) {
+            std::optional<unsigned> kinds = parseKinds(value);
+            if (!kinds) {
+                error = "unknown kind in '" + word.str() + "'";
+                return false;
+            }
+            predicates.kinds = *kinds;
+        } else if (key == "linkage" &&
+                   (value == "c" || value == "internal" ||
+                    value == "external")) {
+            predicates.linkage = value.str();
+        } else if (key == "annotated" && !value.empty()) {
+            predicates.annotation = value.str();
+        } else {
+            break;
+        }
+        rest = tail.ltrim();
+    }
+
+    // rules with the same predicates share a trie and a regex
+    std::vector<RuleGroup> &groups =
+        action == "keep" ? keepGroups : renameGroups;
+    auto it = llvm::find_if(groups, [&](const RuleGroup &group) {
+        return group.kinds == predicates.kinds &&
+               group.linkage == predicates.linkage &&
+               group.annotation == predicates.annotation;
+    });
+    RuleGroup &group =
+        it != groups.end() ? *it : groups.emplace_back(std::move(predicates));
+
+    auto [form, pattern] = rest.split(' ');
+    pattern = pattern.trim();
+    if (form.empty()) {
+        group.anyName = true;
+    } else if (pattern.empty()) {
+        error = "missing pattern after '" + form.str() + "'";
+        return false;
+    } else if (form == "namespace") {
+        group.names.insert(pattern, /*subtree=*/true);
+    } else if (form == "name") {
+        group.names.insert(pattern, /*subtree=*/false);
+    } else if (form == "glob") {
+        group.patterns.push_back(globToRegex(pattern));
+    } else if (form == "regex") {
+        std::string regexError;
+        if (!llvm::Regex(pattern).isValid(regexError)) {
+            error = "bad regex: " + regexError;
+            return false;
+        }
+        group.patterns.push_back(pattern.str());
+    } else {
+        error = "unknown rule part '" + form.str() + "'";
+        return false;
+    }
+    ++rules;
+    return true;
+}
+
+bool NamePolicy::compile(std::string &error) {
+    for (auto *groups : {&keepGroups, &renameGroups}) {
+        for (RuleGroup &group : *groups) {
+            if (group.patterns.empty())
+                continue;
+            std::string alternation;
+            for (const std::string &pattern : group.patterns) {
+                if (!alternation.empty())
+                    alternation += '|';
+                alternation += "(" + pattern + ")";
+            }
+            group.regex.emplace(alternation);
+            if (!group.regex->isValid(error))
+                return false;
+        }
+    }
+    return true;
+}
+
+NamePolicy NamePolicy::builtin() {
+    NamePolicy policy;
+    std::string error;
+    llvm::SmallVector<llvm::StringRef, 16> lines;
+    builtinRules.split(lines, '\n', -1, /*KeepEmpty=*/false);
+    for (llvm::StringRef line : lines)
+        policy.addRule(line, error);
+    policy.compile(error);
+    return policy;
+}
+
+std::optional<NamePolicy> NamePolicy::load(const std::string &path) {
+    auto bufferOrError = llvm::MemoryBuffer::getFile(path, /*IsText=*/true);
+    if (!bufferOrError) {
+        llvm::errs() << "Failed to read policy " << path << ": "
+                     << bufferOrError.getError().message() << "\n";
+        return std::nullopt;
+    }
+
+    NamePolicy policy = builtin();
+    std::string error;
+    llvm::SmallVector<llvm::StringRef, 64> lines;
+    (*bufferOrError)->getBuffer().split(lines, '\n');
+    for (size_t i = 0; i < lines.size(); ++i) {
+        llvm::StringRef line = lines[i].split('#').first.trim();
+        if (line.empty())
+            continue;
+        if (!policy.addRule(line, error)) {
+            llvm::errs() << path << ":" << i + 1 << ": " << error << "\n";
+            return std::nullopt;
+        }
+    }
+    if (!policy.compile(error)) {
+        llvm::errs() << path << ": " << error << "\n";
+        return std::nullopt;
+    }
+    return policy;
+}
+
+bool NamePolicy::keeps(const SymbolFacts &facts) const {
+    auto matches = [&](const RuleGroup &group) {
+        return group.matches(facts);
+    };
+    return llvm::any_of(keepGroups, matches) &&
+           !llvm::any_of(renameGroups, matches);
+}
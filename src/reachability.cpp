@@ -0,0 +1,111 @@
+#include "stdafx.h"
+
+void ReferenceGraph::addEdge(const std::string &from, const std::string &to) {
+    if (from != to)
+        edges[from].push_back(to);
+}
+
+void ReferenceGraph::addRoot(const std::string &key) {
+    roots.insert(key);
+}
+
+std::unordered_set<std::string> ReferenceGraph::reachable() const {
+    std::unordered_set<std::string> seen(roots.begin(), roots.end());
+    std::vector<const std::string *> worklist;
+    for (const auto &root : seen)
+        worklist.push_back(&root);
+
+    while (!worklist.empty()) {
+        const std::string *key = worklist.back();
+        worklist.pop_back();
+
+        auto it = edges.find(*key);
+        if (it == edges.end())
+            continue;
+        for (const auto &next : it->second) {
+            auto [pos, inserted] = seen.insert(next);
+            if (inserted)
+                worklist.push_back(&*pos);
+        }
+    }
+    return seen;
+}
+
+static const char sectionBeginPrefix[] = "/*tinysea:";
+static const char sectionBeginSuffix[] = "{*/";
+const char sectionEndMarker[] = "/*tinysea}*/";
+
+std::string sectionBeginMarker(const std::string &owner) {
+    return sectionBeginPrefix + owner + sectionBeginSuffix;
+}
+
+// appends `text` to `out` with everything but line breaks and directive
+// lines (with their continuations) dropped
+static void appendBlanked(llvm::StringRef text, bool atLineStart,
+                          std::string &out) {
+    bool continued = false;
+    while (true) {
+        auto [line, rest] = text.split('\n');
+        bool keep = continued ||
+                    (atLineStart && line.ltrim(" \t").starts_with("#"));
+        if (keep)
+            out += line;
+        continued = keep && line.rtrim("\r").ends_with("\\");
+        if (line.size() == text.size())
+            return;
+        out += '\n';
+        text = rest;
+        atLineStart = true;
+    }
+}
+
+std::optional<size_t>
+removeDeadSections(std::string &text,
+                   const std::unordered_set<std::string> &live,
+                   std::set<std::string> &dropped) {
+    const size_t prefixSize = sizeof(sectionBeginPrefix) - 1;
+    const size_t suffixSize = sizeof(sectionBeginSuffix) - 1;
+    const size_t endSize = sizeof(sectionEndMarker) - 1;
+    if (text.find(sectionBeginPrefix) == std::string::npos)
+        return std::nullopt;
+
+    std::string out;
+    out.reserve(text.size());
+    size_t removed = 0;
+    size_t pos = 0;
+    while (true) {
+        size_t begin = text.find(sectionBeginPrefix, pos);
+        size_t nameEnd = begin == std::string::npos
+                             ? std::string::npos
+                             : text.find(sectionBeginSuffix, begin);
+        size_t end = nameEnd == std::string::npos
+                         ? std::string::npos
+                         : text.find(sectionEndMarker, nameEnd);
+        if (end == std::string::npos) {
+            out.append(text, pos, std::string::npos);
+            break;
+        }
+        out.append(text, pos, begin - pos);
+
+        std::string owner =
+            text.substr(begin + prefixSize, nameEnd - begin - prefixSize);
+        llvm::StringRef body(text.data() + nameEnd + suffixSize,
+                             end - nameEnd - suffixSize);
+        if (live.count(owner)) {
+            out += body;
+        } else {
+            // only whitespace before the section on its line
+            size_t lineBegin = out.rfind('\n');
+            lineBegin = lineBegin == std::string::npos ? 0 : lineBegin + 1;
+            bool atLineStart =
+                llvm::StringRef(out).substr(lineBegin).trim().empty();
+            size_t before = out.size();
+            appendBlanked(body, atLineStart, out);
+            removed += body.size() - (out.size() - before);
+            dropped.insert(std::move(owner));
+        }
+        pos = end + endSize;
+    }
+    text = std::move(out);
+    return removed;
+}
@@ -1,5 +1,7 @@
 #include "stdafx.h"
 
+#define DEBUG_TYPE "tinysea-renamer"
+
 std::string Renamer::generateName(unsigned index) {
     std::string name;
     unsigned n = index;
@@ -43,122 +45,921 @@ void Renamer::initKeywords() {
     reservedKeywords.insert(keywords.begin(), keywords.end());
 }
 
+// letters ordered by how often they occur in C++ source, so the names handed
+// out first reuse the symbols a compressor's entropy stage already favours
+static constexpr llvm::StringLiteral frequencyAlphabet =
+    "etranoisplcudmfhybgvxwkqzj";
+
+std::string Renamer::nameForIndex(unsigned index) const {
+    std::string name = generateName(index);
+    if (naming == NamingStrategy::Cooccurrence) {
+        for (char &c : name)
+            c = frequencyAlphabet[c - 'a'];
+    }
+    return name;
+}
+
+unsigned Renamer::indexForName(llvm::StringRef name) const {
+    std::string sequential = name.str();
+    if (naming == NamingStrategy::Cooccurrence) {
+        for (char &c : sequential)
+            c = 'a' + frequencyAlphabet.find(c);
+    }
+    return shortNameToIndex(sequential);
+}
+
 unsigned Renamer::shortNameToIndex(const std::string &name) {
+    // the inverse of generateName: base 26 with 'a' as zero, which never
+    // leads a longer name
+    if (name.empty() || (name.size() > 1 && name[0] == 'a'))
+        return UINT_MAX;
     unsigned value = 0;
-    for (auto it = name.rbegin(); it != name.rend(); ++it) {
-        char c = *it;
-        if (c < 'a' || c > 'z')
-            return UINT_MAX; // Invalid character
-        value = value * 26 + (c - 'a' + 1);
+    for (char c : name) {
+        if (c < 'a' || c > 'z' || value > (UINT_MAX - 25) / 26)
+            return UINT_MAX;
+        value = value * 26 + (c - 'a');
     }
-    return value - 1; // Account for +1 offset in generation
+    return value;
+}
+
+// the index a mapping entry's short name was generated from, or UINT_MAX
+unsigned Renamer::indexOfEntry(llvm::StringRef key,
+                               llvm::StringRef shortName) const {
+    if (key.starts_with("#") && !shortName.consume_back("_"))
+        return UINT_MAX;
+    return indexForName(shortName);
+}
+
+Renamer::Renamer() {}
+
+bool Renamer::isReservedKeyword(const std::string &name) {
+    std::lock_guard<std::mutex> lock(mutex);
+    ensureInitialized();
+    return reservedKeywords.count(name);
 }
 
-Renamer::Renamer() {
+void Renamer::ensureInitialized() {
+    if (initialized)
+        return;
+    initialized = true;
+
     initKeywords();
+
+    if (pendingMappings) {
+        parseMappingFile(pendingMappings->getBuffer());
+        pendingMappings.reset();
+    }
+    if (gc)
+        reclaimIndices();
+
+    // an overlay written before its base existed can reuse the base's
+    // names; those entries move to the overlay's own range
+    if (baseMapping) {
+        for (auto &pair : identifierMap) {
+            llvm::StringRef owner = baseMapping->original(pair.second);
+            if (owner.empty() || owner == pair.first)
+                continue;
+            std::string shortName =
+                nameForIndex(nextIndex()) +
+                (llvm::StringRef(pair.first).starts_with("#") ? "_" : "");
+            llvm::errs() << "warning: " << pair.first
+                         << " shared the short name " << pair.second
+                         << " with base mapping entry " << owner
+                         << ", now " << shortName << "\n";
+            pair.second = shortName;
+            stats.add(Stats::MappingsMoved);
+        }
+    }
 }
 
 void Renamer::loadMappings(const std::string &filename) {
-    std::ifstream file(filename);
-    if (!file)
+    std::lock_guard<std::mutex> lock(mutex);
+
+    // MemoryBuffer mmaps the file when it is large enough to be worth it
+    auto bufferOrError = llvm::MemoryBuffer::getFile(
+        filename, /*IsText=*/false, /*RequiresNullTerminator=*/false);
+    if (!bufferOrError)
         return;
 
-    std::string content((std::istreambuf_iterator<char>(file)),
-                        std::istreambuf_iterator<char>());
+    if (initialized) {
+        parseMappingFile((*bufferOrError)->getBuffer());
+    } else {
+        pendingMappings = std::move(*bufferOrError);
+    }
+}
 
-    auto jsonOrError = llvm::json::parse(content);
-    if (!jsonOrError) {
-        llvm::errs() << "Failed to parse JSON: "
-                     << toString(jsonOrError.takeError()) << "\n";
-        return;
+// Mapping files are a flat JSON object of key -> short name. Version 2 adds
+// usage metadata under a key no declaration or macro can have; readers that
+// only look at string values skip it.
+static constexpr llvm::StringLiteral metadataKey = "@tinysea";
+static constexpr int64_t mappingFormatVersion = 2;
+
+// calls `entry` for every key/short name pair in a plain or framed mapping
+// file, and `metadata` with the metadata object if there is one; compressed
+// files hold one JSON object per frame
+static bool
+forEachEntry(llvm::StringRef content,
+             llvm::function_ref<void(llvm::StringRef, llvm::StringRef)> entry,
+             llvm::function_ref<void(const llvm::json::Object &)> metadata =
+                 {}) {
+    auto parseObject = [&](llvm::StringRef json) {
+        auto jsonOrError = llvm::json::parse(json);
+        if (!jsonOrError) {
+            llvm::errs() << "Failed to parse JSON: "
+                         << toString(jsonOrError.takeError()) << "\n";
+            return false;
+        }
+        if (auto obj = jsonOrError->getAsObject()) {
+            for (auto &pair : *obj) {
+                if (auto shortName = pair.getSecond().getAsString()) {
+                    entry(pair.getFirst(), *shortName);
+                } else if (metadata &&
+                           llvm::StringRef(pair.getFirst()) == metadataKey) {
+                    if (auto meta = pair.getSecond().getAsObject())
+                        metadata(*meta);
+                }
+            }
+        }
+        return true;
+    };
+
+    if (!isFramed(content))
+        return parseObject(content);
+
+    auto frames = readFrameIndex(content);
+    if (!frames)
+        return false;
+    std::string json;
+    for (const FrameInfo &frame : *frames) {
+        json.clear();
+        if (!readFrame(content, frame.offset, json) || !parseObject(json))
+            return false;
+    }
+    return true;
+}
+
+bool Renamer::forEachMapping(
+    const std::string &filename,
+    llvm::function_ref<void(llvm::StringRef, llvm::StringRef)> entry,
+    llvm::function_ref<void(const llvm::json::Object &)> metadata) {
+    auto bufferOrError = llvm::MemoryBuffer::getFile(
+        filename, /*IsText=*/false, /*RequiresNullTerminator=*/false);
+    if (!bufferOrError) {
+        llvm::errs() << "Failed to read " << filename << ": "
+                     << bufferOrError.getError().message() << "\n";
+        return false;
     }
+    return forEachEntry((*bufferOrError)->getBuffer(), entry, metadata);
+}
+
+static llvm::StringRef namingName(NamingStrategy strategy) {
+    return strategy == NamingStrategy::Cooccurrence ? "cooccurrence"
+                                                    : "sequential";
+}
+
+void Renamer::parseMappingFile(llvm::StringRef content) {
+    // the entries are kept aside until the metadata, which may come after
+    // them, has said which alphabet their short names are spelled in
+    std::vector<std::pair<std::string, std::string>> entries;
+    llvm::StringMap<std::string> moves;
+    bool refused = false;
+    auto entry = [&](llvm::StringRef original, llvm::StringRef shortName) {
+        entries.emplace_back(original.str(), shortName.str());
+    };
+    auto metadata = [&](const llvm::json::Object &meta) {
+        // files from before the strategy was recorded use --naming as given
+        if (auto stored = meta.getString("naming")) {
+            if (*stored != "sequential" && *stored != "cooccurrence") {
+                llvm::errs() << "Ignoring mapping with unknown naming "
+                             << *stored << "\n";
+                refused = true;
+                return;
+            }
+            NamingStrategy strategy = *stored == "cooccurrence"
+                                          ? NamingStrategy::Cooccurrence
+                                          : NamingStrategy::Sequential;
+            if (strategy != naming) {
+                // names already handed out are spelled in the current
+                // alphabet, and mixing the two could repeat one
+                if (!identifierMap.empty() || currentIndex != 0) {
+                    llvm::errs() << "Ignoring mapping written with --naming="
+                                 << *stored << ", not --naming="
+                                 << namingName(naming) << "\n";
+                    refused = true;
+                    return;
+                }
+                llvm::errs() << "warning: mapping was written with --naming="
+                             << *stored << "; using it instead of --naming="
+                             << namingName(naming) << "\n";
+                naming = strategy;
+            }
+        }
+        parseMetadata(meta, moves);
+    };
+    forEachEntry(content, entry, metadata);
+    if (refused)
+        return;
 
     unsigned maxIndex = 0;
-    if (auto obj = jsonOrError->getAsObject()) {
-        for (auto &pair : *obj) {
-            std::string original = pair.getFirst().str();
-            std::string shortName =
-                pair.getSecond().getAsString().value().str();
+    for (auto &[original, shortName] : entries) {
+        // macro names carry a trailing underscore on top of the usual
+        // index, see getMacroShortName
+        llvm::StringRef indexName = shortName;
+        if (llvm::StringRef(original).starts_with("#"))
+            indexName.consume_back("_");
+
+        // Validate short name format
+        bool valid = !indexName.empty() &&
+                     std::all_of(indexName.begin(), indexName.end(),
+                                 [](char c) { return c >= 'a' && c <= 'z'; });
+
+        if (!valid) {
+            llvm::errs() << "Skipping invalid short name: " << shortName
+                         << "\n";
+            continue;
+        }
+
+        // Track maximum index
+        unsigned index = indexForName(indexName);
+        if (index != UINT_MAX && index >= maxIndex) {
+            maxIndex = index + 1; // Set to next available index
+        }
 
-            // Validate short name format
-            bool valid =
-                std::all_of(shortName.begin(), shortName.end(),
-                            [](char c) { return c >= 'a' && c <= 'z'; });
+        identifierMap[std::move(original)] = std::move(shortName);
+    }
+
+    // moves only ever go to lower indices, so maxIndex still holds
+    for (const auto &move : moves) {
+        auto it = identifierMap.find(move.getKey().str());
+        if (it != identifierMap.end())
+            it->second = move.getValue();
+    }
 
-            if (!valid) {
-                llvm::errs()
-                    << "Skipping invalid short name: " << shortName << "\n";
+    currentIndex = std::max(currentIndex, maxIndex);
+}
+
+void Renamer::parseMetadata(const llvm::json::Object &meta,
+                            llvm::StringMap<std::string> &moves) {
+    if (meta.getInteger("version") != mappingFormatVersion) {
+        llvm::errs() << "Ignoring mapping metadata of unknown version\n";
+        return;
+    }
+    if (auto runs = meta.getInteger("runs"))
+        run = *runs + 1;
+
+    // every file records its naming; only some also track usage
+    if (const auto *seen = meta.getObject("usage")) {
+        trackUsage = true;
+        for (const auto &pair : *seen) {
+            const auto *fields = pair.getSecond().getAsArray();
+            if (!fields || fields->size() != 2)
                 continue;
-            }
+            auto lastSeen = (*fields)[0].getAsInteger();
+            auto uses = (*fields)[1].getAsInteger();
+            if (lastSeen && uses)
+                usage[llvm::StringRef(pair.getFirst()).str()] = {
+                    unsigned(*lastSeen), uint64_t(*uses)};
+        }
+    }
+    if (const auto *planned = meta.getObject("moves")) {
+        for (const auto &pair : *planned) {
+            if (auto shortName = pair.getSecond().getAsString())
+                moves[pair.getFirst()] = shortName->str();
+        }
+    }
+}
 
-            // Track maximum index
-            unsigned index = shortNameToIndex(shortName);
-            if (index != UINT_MAX && index >= maxIndex) {
-                maxIndex = index + 1; // Set to next available index
-            }
+llvm::json::Object Renamer::metadata() const {
+    llvm::json::Object moves;
+    for (const auto &pair : plannedMoves)
+        moves[pair.first] = pair.second;
 
-            identifierMap[original] = shortName;
+    llvm::json::Object meta;
+    meta["version"] = mappingFormatVersion;
+    // short names are spelled in the strategy's alphabet, so a later run
+    // has to read them back with the same one
+    meta["naming"] = namingName(naming);
+    if (trackUsage || !placeholderPrefix.empty()) {
+        llvm::json::Object seen;
+        for (const auto &pair : identifierMap) {
+            Usage entry = usageOf(pair.first);
+            seen[pair.first] = llvm::json::Array{entry.lastSeen, entry.uses};
         }
+        meta["runs"] = run;
+        meta["usage"] = std::move(seen);
     }
+    if (!moves.empty())
+        meta["moves"] = std::move(moves);
+    // a shard's names are only final after merge-mappings, which has to
+    // avoid what every shard's system headers and project files spell; a
+    // shard only scans its own TUs, so the union covers the project
+    if (!placeholderPrefix.empty()) {
+        llvm::json::Array external;
+        for (std::string &name : externalNames.sorted())
+            external.push_back(std::move(name));
+        meta["external"] = std::move(external);
 
-    currentIndex = maxIndex;
+        std::vector<llvm::StringRef> names;
+        for (const auto &name : projectSpellings)
+            names.push_back(name.getKey());
+        llvm::sort(names);
+        meta["spellings"] = llvm::json::Array(names);
+    }
+    return meta;
 }
 
-void Renamer::saveMappings(const std::string &filename) {
-    llvm::json::Object jsonMap;
+// entries from before usage was tracked count as used in the previous run
+Renamer::Usage Renamer::usageOf(const std::string &key) const {
+    auto it = usage.find(key);
+    return it != usage.end() ? it->second : Usage{run - 1, 0};
+}
+
+void Renamer::noteUse(const std::string &key) {
+    if (!trackUsage)
+        return;
+    Usage &entry = usage[key];
+    if (entry.lastSeen != run)
+        entry = {run, 0};
+    ++entry.uses;
+}
+
+void Renamer::reclaimIndices() {
+    llvm::BitVector held(currentIndex);
     for (const auto &pair : identifierMap) {
-        jsonMap[pair.first] = pair.second;
+        unsigned index = indexOfEntry(pair.first, pair.second);
+        if (index < currentIndex)
+            held.set(index);
+    }
+    // everything below firstIndex belongs to the base mapping
+    for (unsigned index = firstIndex; index < currentIndex; ++index) {
+        if (!held.test(index))
+            reclaimedIndices.insert(index);
     }
+}
+
+void Renamer::setGarbageCollection(MappingGC settings) {
+    std::lock_guard<std::mutex> lock(mutex);
+    gc = settings;
+    trackUsage = true;
+}
+
+void Renamer::collectGarbage() {
+    std::lock_guard<std::mutex> lock(mutex);
+    ensureInitialized();
+    if (!gc)
+        return;
+
+    unsigned oldest = run > gc->graceRuns ? run - gc->graceRuns : 0;
+    for (auto it = identifierMap.begin(); it != identifierMap.end();) {
+        if (usageOf(it->first).lastSeen >= oldest) {
+            ++it;
+            continue;
+        }
+        usage.erase(it->first);
+        it = identifierMap.erase(it);
+        stats.add(Stats::MappingsDropped);
+    }
+    planMoves();
+}
+
+static unsigned nameLength(unsigned index) {
+    unsigned length = 1;
+    for (; index >= 26; index /= 26)
+        ++length;
+    return length;
+}
+
+// Greedily moves the most used entries onto shorter names: a free name
+// costs one move, a swap with a less used holder of a shorter name two.
+// Stops at gc->maxMoves so a mapping settles over a few runs instead of
+// renaming half the project at once.
+void Renamer::planMoves() {
+    plannedMoves.clear();
+    if (!gc->maxMoves)
+        return;
+
+    struct Entry {
+        const std::string *key;
+        unsigned index;
+        bool macro;
+        uint64_t uses;
+        bool moved = false;
+    };
+    std::vector<Entry> entries;
+    llvm::BitVector held(currentIndex);
+    for (const auto &pair : identifierMap) {
+        unsigned index = indexOfEntry(pair.first, pair.second);
+        if (index >= currentIndex)
+            continue;
+        held.set(index);
+        entries.push_back({&pair.first, index,
+                           llvm::StringRef(pair.first).starts_with("#"),
+                           usageOf(pair.first).uses});
+    }
+    llvm::sort(entries, [](const Entry &a, const Entry &b) {
+        return a.uses != b.uses ? a.uses > b.uses : a.index < b.index;
+    });
+
+    std::set<unsigned> freeNames;
+    for (unsigned index = firstIndex; index < currentIndex; ++index) {
+        if (!held.test(index))
+            freeNames.insert(index);
+    }
+    // holders of each name length, least used first
+    std::vector<std::deque<size_t>> byLength(nameLength(currentIndex) + 1);
+    for (size_t i = entries.size(); i-- > 0;)
+        byLength[nameLength(entries[i].index)].push_back(i);
+
+    auto fits = [&](unsigned index, bool macro) {
+        std::string name = nameForIndex(index) + (macro ? "_" : "");
+        return !reservedKeywords.count(name) &&
+               !(baseMapping && !baseMapping->original(name).empty()) &&
+               !externalNames.contains(name);
+    };
+    unsigned moves = 0;
+    auto move = [&](Entry &entry, unsigned index) {
+        plannedMoves[*entry.key] =
+            nameForIndex(index) + (entry.macro ? "_" : "");
+        entry.index = index;
+        entry.moved = true;
+        ++moves;
+        stats.add(Stats::MappingsMoved);
+    };
+
+    for (Entry &entry : entries) {
+        if (moves >= gc->maxMoves || !entry.uses)
+            break;
+        if (entry.moved)
+            continue;
+        unsigned length = nameLength(entry.index);
+
+        auto slot = llvm::find_if(freeNames, [&](unsigned index) {
+            return nameLength(index) >= length || fits(index, entry.macro);
+        });
+        if (slot != freeNames.end() && nameLength(*slot) < length) {
+            unsigned old = entry.index;
+            move(entry, *slot);
+            freeNames.erase(slot);
+            freeNames.insert(old);
+            continue;
+        }
+
+        if (moves + 2 > gc->maxMoves)
+            continue;
+        for (unsigned shorter = 1; shorter < length; ++shorter) {
+            std::deque<size_t> &holders = byLength[shorter];
+            while (!holders.empty() && entries[holders.front()].moved)
+                holders.pop_front();
+            if (holders.empty())
+                continue;
+            Entry &other = entries[holders.front()];
+            if (other.uses >= entry.uses || !fits(other.index, entry.macro) ||
+                !fits(entry.index, other.macro))
+                continue;
+            holders.pop_front();
+            unsigned index = other.index;
+            move(other, entry.index);
+            move(entry, index);
+            break;
+        }
+    }
+}
+
+bool Renamer::writeMappingIndex(const std::string &path) {
+    std::lock_guard<std::mutex> lock(mutex);
+    ensureInitialized();
+    return MappingIndex::write(identifierMap, path, currentIndex);
+}
+
+void Renamer::saveMappings(const std::string &filename,
+                           OutputCompression compression) {
+    std::lock_guard<std::mutex> lock(mutex);
+    ensureInitialized();
 
     std::error_code ec;
     llvm::raw_fd_ostream out(filename, ec);
-    if (!ec) {
-        out << llvm::json::Value(std::move(jsonMap));
-    } else {
+    if (ec) {
         llvm::errs() << "Failed to write mappings: " << ec.message() << "\n";
+        return;
     }
-}
 
-std::string Renamer::getShortName(const std::string &qualifiedName) {
-    static const std::set<std::string> preservedTypes = {
-        "int",  "char",      "void",   "bool",      "float",       "double",
-        "main", "ptrdiff_t", "size_t", "nullptr_t", "max_align_t", "NULL"};
+    if (compression == OutputCompression::None) {
+        llvm::json::Object jsonMap;
+        for (const auto &pair : identifierMap) {
+            jsonMap[pair.first] = pair.second;
+        }
+        jsonMap[metadataKey] = metadata();
+        out << llvm::json::Value(std::move(jsonMap));
+        return;
+    }
 
-    // if we find that the qualified name is part of a library, pass it through
-    if (preservedTypes.count(qualifiedName) ||
-        qualifiedName.starts_with("std::")) {
-        return qualifiedName;
+    // stream the map out in chunks, each a JSON object in its own frame, so
+    // the whole document never exists uncompressed
+    constexpr size_t entriesPerFrame = 1 << 16;
+    FramedWriter writer(out, compression, &stats);
+    std::string chunk;
+    llvm::raw_string_ostream os(chunk);
+    size_t entries = 0;
+    unsigned frames = 0;
+    auto flush = [&] {
+        os << "}";
+        writer.addFrame("mappings." + std::to_string(frames++), chunk);
+        chunk.clear();
+    };
+    for (const auto &pair : identifierMap) {
+        os << (entries % entriesPerFrame == 0 ? "{" : ",")
+           << llvm::json::Value(pair.first) << ":"
+           << llvm::json::Value(pair.second);
+        if (++entries % entriesPerFrame == 0)
+            flush();
+    }
+    if (entries % entriesPerFrame != 0 || entries == 0) {
+        if (entries == 0)
+            os << "{";
+        flush();
     }
+    llvm::json::Object meta;
+    meta[metadataKey] = metadata();
+    os << llvm::json::Value(std::move(meta));
+    writer.addFrame("mappings.meta", chunk);
+}
+
+void Renamer::setNamingStrategy(NamingStrategy strategy) {
+    std::lock_guard<std::mutex> lock(mutex);
+    naming = strategy;
+}
+
+NamingStrategy Renamer::getNamingStrategy() {
+    std::lock_guard<std::mutex> lock(mutex);
+    ensureInitialized();
+    return naming;
+}
+
+void Renamer::setPlaceholderPrefix(std::string prefix) {
+    std::lock_guard<std::mutex> lock(mutex);
+    placeholderPrefix = std::move(prefix);
+}
+
+void Renamer::setBaseMapping(std::unique_ptr<MappingIndex> base) {
+    std::lock_guard<std::mutex> lock(mutex);
+    baseMapping = std::move(base);
+    firstIndex = baseMapping->nameEnd();
+    currentIndex = std::max(currentIndex, firstIndex);
+}
+
+std::string Renamer::getShortName(const std::string &qualifiedName,
+                                  llvm::StringRef context) {
+    std::lock_guard<std::mutex> lock(mutex);
+    ensureInitialized();
 
     // if we've already seen the thing before, return the associated shortname
     if (auto it = identifierMap.find(qualifiedName);
         it != identifierMap.end()) {
+        stats.add(Stats::MapHits);
+        noteUse(qualifiedName);
         return it->second;
     }
+    if (baseMapping) {
+        llvm::StringRef shortName = baseMapping->shortName(qualifiedName);
+        if (!shortName.empty()) {
+            stats.add(Stats::BaseMapHits);
+            return shortName.str();
+        }
+    }
+    stats.add(Stats::MapMisses);
 
-    // we didn't find the name, so let's make a new name
-    std::string newName;
+    unsigned index = naming == NamingStrategy::Cooccurrence && !context.empty()
+                         ? blockIndex(context)
+                         : nextIndex();
+    return assignName(qualifiedName, nameForIndex(index));
+}
 
-    do { // generate new names until we get one that's not a reserved keyword
-        newName = generateName(currentIndex++);
-    } while (reservedKeywords.count(newName));
+// keywords, names the base mapping assigned, and anything a project file or
+// a system header spells can't be a short name
+bool Renamer::isUnavailable(const std::string &name) {
+    if (reservedKeywords.count(name) || projectSpellings.contains(name))
+        return true;
+    // a base written with another --naming can overlap the range past its
+    // nameEnd, so its names are still checked one by one
+    if (baseMapping && !baseMapping->original(name).empty())
+        return true;
+    if (!externalNames.contains(name))
+        return false;
+    stats.add(Stats::ExternalNamesSkipped);
+    return true;
+}
 
-    std::cout << "newName: " << newName << std::endl;
+unsigned Renamer::nextIndex() {
+    // names --gc-mappings freed come before new ones
+    while (!reclaimedIndices.empty()) {
+        unsigned index = *reclaimedIndices.begin();
+        reclaimedIndices.erase(reclaimedIndices.begin());
+        if (!isUnavailable(nameForIndex(index)))
+            return index;
+    }
+    while (isUnavailable(nameForIndex(currentIndex)))
+        ++currentIndex;
+    return currentIndex++;
+}
+
+unsigned Renamer::blockIndex(llvm::StringRef context) {
+    NameBlock &block = contextBlocks[context];
+    while (true) {
+        while (block.next < block.end) {
+            unsigned index = block.next++;
+            if (!isUnavailable(nameForIndex(index)))
+                return index;
+        }
 
-    identifierMap[qualifiedName] = newName;
-    return newName;
+        // Claim the next run of free names that differ only in their last
+        // letter, so everything this context introduces shares a prefix even
+        // when other contexts are allocating in between. Runs left over
+        // from contexts that have finished are reused first.
+        auto groupEnd = [](unsigned index) { return (index / 26 + 1) * 26; };
+        if (!freeIndices.empty()) {
+            unsigned start = *freeIndices.begin();
+            unsigned end = start;
+            auto it = freeIndices.begin();
+            while (it != freeIndices.end() && *it == end &&
+                   end < groupEnd(start)) {
+                it = freeIndices.erase(it);
+                ++end;
+            }
+            block = {start, end};
+        } else {
+            unsigned start = currentIndex;
+            currentIndex = std::min(groupEnd(start), start + blockSize);
+            block = {start, currentIndex};
+        }
+    }
 }
 
-bool Renamer::hasMappings() const {
+void Renamer::endContext(llvm::StringRef context) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = contextBlocks.find(context);
+    if (it == contextBlocks.end())
+        return;
+    for (unsigned index = it->second.next; index < it->second.end; ++index)
+        freeIndices.insert(index);
+    contextBlocks.erase(it);
+}
+
+std::string Renamer::assignName(const std::string &key,
+                                const std::string &newName) {
+    LLVM_DEBUG(llvm::dbgs() << "newName: " << newName << "\n");
+    stats.add(Stats::NewNames);
+
+    std::string name = placeholderPrefix + newName;
+    identifierMap[key] = name;
+    noteUse(key);
+    newMappings.emplace_back(key, name);
+    return name;
+}
+
+llvm::StringRef Renamer::getMacroShortName(llvm::StringRef macroName,
+                                           llvm::StringRef file) {
+    std::lock_guard<std::mutex> lock(mutex);
+    ensureInitialized();
+
+    std::string id = macroName.str();
+    if (!file.empty())
+        id += "@" + file.str();
+    std::string key = "#" + id;
+
+    // StringMap entries never move, so the name stays valid for the whole run
+    auto [entry, inserted] = macroNames.try_emplace(id);
+    if (!inserted) {
+        stats.add(Stats::MapHits);
+        if (trackUsage)
+            noteUse(key);
+        return entry->second;
+    }
+
+    // reserved spellings belong to the implementation
+    if (macroName == "NULL" || macroName.starts_with("__") ||
+        (macroName.size() > 1 && macroName[0] == '_' &&
+         llvm::isUppercase(macroName[1]))) {
+        stats.add(Stats::PreservedNames);
+        entry->second = macroName.str();
+        return entry->second;
+    }
+
+    if (auto it = identifierMap.find(key); it != identifierMap.end()) {
+        stats.add(Stats::MapHits);
+        noteUse(key);
+        entry->second = it->second;
+        return entry->second;
+    }
+    if (baseMapping) {
+        llvm::StringRef shortName = baseMapping->shortName(key);
+        if (!shortName.empty()) {
+            stats.add(Stats::BaseMapHits);
+            entry->second = shortName.str();
+            return entry->second;
+        }
+    }
+    stats.add(Stats::MapMisses);
+
+    // a macro replaces every later token with its name, system headers
+    // included, so its short name must not be something the rest of the
+    // code spells. The trailing underscore keeps it out of the names we
+    // generate for declarations and out of the implementation's reserved
+    // space; project and external files are checked for the rest.
+    std::string shortName = nameForIndex(nextIndex()) + "_";
+    while (isUnavailable(shortName))
+        shortName = nameForIndex(nextIndex()) + "_";
+    entry->second = assignName(key, shortName);
+    return entry->second;
+}
+
+void Renamer::addProjectSpellings(
+    llvm::ArrayRef<llvm::StringRef> identifiers) {
+    // only lowercase letters, with a trailing underscore for macros, can
+    // clash with a name we generate
+    auto isCandidate = [](llvm::StringRef name) {
+        name.consume_back("_");
+        return !name.empty() && llvm::all_of(name, [](char c) {
+            return c >= 'a' && c <= 'z';
+        });
+    };
+    std::lock_guard<std::mutex> lock(mutex);
+    for (llvm::StringRef identifier : identifiers) {
+        if (isCandidate(identifier))
+            projectSpellings.insert(identifier);
+    }
+}
+
+bool Renamer::keepsName(const SymbolFacts &facts) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto [it, inserted] = policyVerdicts.try_emplace(facts.key(), false);
+    if (inserted) {
+        stats.add(Stats::PolicyEvaluations);
+        it->second = policy.keeps(facts);
+    }
+    return it->second;
+}
+
+bool Renamer::hasMappings() {
+    std::lock_guard<std::mutex> lock(mutex);
+    ensureInitialized();
     return !identifierMap.empty();
 }
 
 void Renamer::collectTransformedCode(const std::string &filename,
-                                     const std::string &content) {
-    combinedOutput << "// ======== " << filename << " ========\n"
-                   << content << "\n\n";
+                                     const std::string &content,
+                                     const std::string &owner) {
+    std::lock_guard<std::mutex> lock(mutex);
+    sections.push_back({filename, owner, content});
+}
+
+static void appendSection(std::string &out, const OutputSection &section) {
+    out += "// ======== ";
+    out += section.filename;
+    out += " ========\n";
+    out += section.content;
+    out += "\n\n";
+}
+
+void Renamer::writeCombinedOutput(
+    llvm::raw_ostream &os, OutputCompression compression) const {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (compression == OutputCompression::None) {
+        std::string text;
+        for (const auto &section : sections) {
+            text.clear();
+            appendSection(text, section);
+            os << text;
+        }
+        return;
+    }
+
+    // one frame per run of sections from the same file; -j can interleave
+    // files, in which case a file just gets more than one frame
+    FramedWriter writer(os, compression, &stats);
+    std::string frame;
+    for (size_t i = 0; i < sections.size(); ++i) {
+        appendSection(frame, sections[i]);
+        if (i + 1 == sections.size() ||
+            sections[i + 1].filename != sections[i].filename) {
+            writer.addFrame(sections[i].filename, frame);
+            frame.clear();
+        }
+    }
 }
 
 std::string Renamer::getCombinedOutput() const {
-    return combinedOutput.str();
+    std::lock_guard<std::mutex> lock(mutex);
+    std::string output;
+    for (const auto &section : sections)
+        appendSection(output, section);
+    return output;
+}
+
+void Renamer::addReference(const std::string &from, const std::string &to) {
+    std::lock_guard<std::mutex> lock(mutex);
+    references.addEdge(from, to);
+}
+
+void Renamer::addRoot(const std::string &key) {
+    std::lock_guard<std::mutex> lock(mutex);
+    references.addRoot(key);
+}
+
+void Renamer::recordInclude(const std::string &includer,
+                            const IncludeDirective &directive) {
+    std::lock_guard<std::mutex> lock(mutex);
+    includes[includer].directives.emplace(directive.firstLine, directive);
+}
+
+void Renamer::markIncludeGuarded(const std::string &path) {
+    std::lock_guard<std::mutex> lock(mutex);
+    includes[path].guarded = true;
 }
+
+IncludeGraph Renamer::getIncludeGraph() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return includes;
+}
+
+size_t Renamer::eliminateDeadCode(const std::vector<std::string> &keep,
+                                  llvm::raw_ostream *report) {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    references.addRoot("main");
+    for (const auto &key : keep)
+        references.addRoot(key);
+    std::unordered_set<std::string> live = references.reachable();
+
+    size_t removedBytes = 0;
+    std::set<std::string> dropped;
+    std::vector<OutputSection> kept;
+    for (auto &section : sections) {
+        if (section.owner.empty() || live.count(section.owner)) {
+            kept.push_back(std::move(section));
+        } else {
+            removedBytes += section.content.size();
+            dropped.insert(section.owner);
+        }
+    }
+    sections = std::move(kept);
+
+    // with --amalgamate the output comes from the rewritten files instead,
+    // where the same declarations are marked
+    std::optional<size_t> fileBytes;
+    for (auto &[path, text] : rewrittenFiles) {
+        if (auto removed = removeDeadSections(text, live, dropped))
+            fileBytes = fileBytes.value_or(0) + *removed;
+    }
+    if (fileBytes)
+        removedBytes = *fileBytes;
+
+    if (report) {
+        *report << "dropped " << dropped.size() << " unreachable declarations ("
+                << removedBytes << " bytes)\n";
+        for (const auto &owner : dropped)
+            *report << "  " << owner << "\n";
+    }
+    return removedBytes;
+}
+
+void Renamer::collectRewrittenFile(const std::string &filename,
+                                   const std::string &content) {
+    std::lock_guard<std::mutex> lock(mutex);
+    rewrittenFiles[filename] = content;
+}
+
+const std::map<std::string, std::string> &Renamer::getRewrittenFiles() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return rewrittenFiles;
+}
+
+void Renamer::collectVerifyBuffer(const std::string &path,
+                                  BufferVersions buffer) {
+    std::lock_guard<std::mutex> lock(mutex);
+    verifyBuffers[path] = std::move(buffer);
+}
+
+const std::map<std::string, BufferVersions> &
+Renamer::getVerifyBuffers() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return verifyBuffers;
+}
+
+std::map<std::string, std::string> Renamer::takeRewrittenFiles() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return std::exchange(rewrittenFiles, {});
+}
+
+std::string Renamer::takeCombinedOutput() {
+    std::lock_guard<std::mutex> lock(mutex);
+    std::string output;
+    for (const auto &section : sections)
+        appendSection(output, section);
+    sections.clear();
+    return output;
+}
+
+std::vector<std::pair<std::string, std::string>> Renamer::takeNewMappings() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return std::exchange(newMappings, {});
+}
\ No newline at end of file
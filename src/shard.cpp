@@ -0,0 +1,174 @@
+#include "stdafx.h"
+
+// placeholders are spelled in the implementation's reserved namespace, so
+// nothing in a project can already be using one
+static constexpr llvm::StringLiteral placeholderStart = "__ts";
+
+std::optional<ShardSpec> ShardSpec::parse(llvm::StringRef text) {
+    auto [index, count] = text.split('/');
+    ShardSpec spec;
+    if (index.getAsInteger(10, spec.index) ||
+        count.getAsInteger(10, spec.count) || spec.count == 0 ||
+        spec.index >= spec.count) {
+        llvm::errs() << "Invalid --shard '" << text
+                     << "', expected i/N with 0 <= i < N\n";
+        return std::nullopt;
+    }
+    return spec;
+}
+
+std::vector<std::string>
+ShardSpec::select(const std::vector<std::string> &sources) const {
+    std::vector<std::string> paths;
+    for (const std::string &source : sources)
+        paths.push_back(normalizedPath(source));
+
+    // strip the directory every source shares, so the split doesn't depend
+    // on where the project is checked out
+    size_t strip = commonDirectory(paths).size();
+
+    std::vector<std::string> selected;
+    for (size_t i = 0; i < sources.size(); ++i) {
+        llvm::StringRef relative = llvm::StringRef(paths[i]).drop_front(strip);
+        if (llvm::xxh3_64bits(llvm::arrayRefFromStringRef(relative)) % count ==
+            index)
+            selected.push_back(sources[i]);
+    }
+    return selected;
+}
+
+std::string ShardSpec::placeholderPrefix() const {
+    return placeholderStart.str() + std::to_string(index) + "_";
+}
+
+uint64_t replacePlaceholders(const llvm::StringMap<std::string> &names,
+                             llvm::StringRef input, llvm::raw_ostream &out) {
+    uint64_t replaced = 0;
+    size_t copied = 0;
+    size_t pos = 0;
+    while ((pos = input.find(placeholderStart, pos)) !=
+           llvm::StringRef::npos) {
+        // only whole identifiers count
+        if (pos > 0 && clang::isAsciiIdentifierContinue(input[pos - 1])) {
+            pos += placeholderStart.size();
+            continue;
+        }
+        size_t end = pos;
+        while (end < input.size() &&
+               clang::isAsciiIdentifierContinue(input[end]))
+            ++end;
+
+        auto it = names.find(input.slice(pos, end));
+        if (it != names.end()) {
+            out << input.slice(copied, pos) << it->second;
+            copied = end;
+            ++replaced;
+        }
+        pos = end;
+    }
+    out << input.drop_front(copied);
+    return replaced;
+}
+
+int mergeMappings(const std::vector<std::string> &shardMappings,
+                  const std::string &base, const std::string &output,
+                  const std::vector<std::string> &rewrite, unsigned jobs) {
+    // placeholder -> key, and every key that got one
+    llvm::StringMap<std::string> placeholders;
+    std::set<std::string> keys;
+    // what the shards' system headers and project files spell; no final
+    // name may be one
+    llvm::StringSet<> external;
+    llvm::StringSet<> spellings;
+    for (const std::string &mapping : shardMappings) {
+        bool ok = Renamer::forEachMapping(
+            mapping,
+            [&](llvm::StringRef key, llvm::StringRef shortName) {
+                // anything else came from the base mapping
+                if (!shortName.starts_with(placeholderStart))
+                    return;
+                placeholders[shortName] = key.str();
+                keys.insert(key.str());
+            },
+            [&](const llvm::json::Object &meta) {
+                auto collect = [&](llvm::StringRef field,
+                                   llvm::StringSet<> &into) {
+                    const llvm::json::Array *names = meta.getArray(field);
+                    if (!names)
+                        return;
+                    for (const llvm::json::Value &name : *names) {
+                        if (auto text = name.getAsString())
+                            into.insert(*text);
+                    }
+                };
+                collect("external", external);
+                collect("spellings", spellings);
+            });
+        if (!ok)
+            return 1;
+    }
+
+    Renamer renamer;
+    if (!base.empty())
+        renamer.loadMappings(base);
+    std::vector<llvm::StringRef> externalNames;
+    for (const auto &name : external)
+        externalNames.push_back(name.getKey());
+    renamer.getExternalNames().insert(externalNames);
+    std::vector<llvm::StringRef> projectSpellings;
+    for (const auto &name : spellings)
+        projectSpellings.push_back(name.getKey());
+    renamer.addProjectSpellings(projectSpellings);
+    std::map<std::string, std::string> finalNames;
+    for (const std::string &key : keys) {
+        if (!llvm::StringRef(key).starts_with("#")) {
+            finalNames[key] = renamer.getShortName(key);
+            continue;
+        }
+        auto [macro, file] = llvm::StringRef(key).drop_front().split('@');
+        finalNames[key] = renamer.getMacroShortName(macro, file).str();
+    }
+    renamer.saveMappings(output);
+
+    llvm::StringMap<std::string> replacements;
+    for (const auto &[placeholder, key] : placeholders)
+        replacements[placeholder] = finalNames[key];
+
+    std::atomic<uint64_t> filesRewritten = 0, namesReplaced = 0;
+    std::atomic<bool> failed = false;
+    {
+        llvm::ThreadPool pool(llvm::hardware_concurrency(jobs));
+        for (const std::string &path : rewrite) {
+            pool.async([&, path] {
+                auto input = llvm::MemoryBuffer::getFile(
+                    path, /*IsText=*/false, /*RequiresNullTerminator=*/false);
+                if (!input) {
+                    llvm::errs() << "Failed to read " << path << ": "
+                                 << input.getError().message() << "\n";
+                    failed = true;
+                    return;
+                }
+                std::string text;
+                llvm::raw_string_ostream os(text);
+                uint64_t replaced = replacePlaceholders(
+                    replacements, (*input)->getBuffer(), os);
+                os.flush();
+                if (!replaced)
+                    return;
+                if (!writeFile(path, text)) {
+                    failed = true;
+                    return;
+                }
+                ++filesRewritten;
+                namesReplaced += replaced;
+            });
+        }
+        pool.wait();
+    }
+
+    llvm::errs() << "merge-mappings: " << keys.size() << " names from "
+                 << shardMappings.size() << " shard(s), "
+                 << namesReplaced.load() << " replacements in "
+                 << filesRewritten.load() << " file(s)\n";
+    return failed ? 1 : 0;
+}
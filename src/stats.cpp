@@ -0,0 +1,179 @@
+#include "stdafx.h"
+
+#include <sys/resource.h>
+
+static const char *counterName(Stats::Counter counter) {
+    switch (counter) {
+    case Stats::DeclsVisited:
+        return "declsVisited";
+    case Stats::DeclarationsRewritten:
+        return "declarationsRewritten";
+    case Stats::ReferencesRewritten:
+        return "referencesRewritten";
+    case Stats::MapHits:
+        return "mapHits";
+    case Stats::MapMisses:
+        return "mapMisses";
+    case Stats::NewNames:
+        return "newNames";
+    case Stats::PreservedNames:
+        return "preservedNames";
+    case Stats::IntegerLiteralBytesSaved:
+        return "integerLiteralBytesSaved";
+    case Stats::FloatingLiteralBytesSaved:
+        return "floatingLiteralBytesSaved";
+    case Stats::BoolLiteralBytesSaved:
+        return "boolLiteralBytesSaved";
+    case Stats::SectionsEmitted:
+        return "sectionsEmitted";
+    case Stats::SectionBytes:
+        return "sectionBytes";
+    case Stats::NestedSectionsSkipped:
+        return "nestedSectionsSkipped";
+    case Stats::MacroNamesRewritten:
+        return "macroNamesRewritten";
+    case Stats::MacroParamsRewritten:
+        return "macroParamsRewritten";
+    case Stats::MacroBytesSaved:
+        return "macroBytesSaved";
+    case Stats::CompressionInputBytes:
+        return "compressionInputBytes";
+    case Stats::CompressionOutputBytes:
+        return "compressionOutputBytes";
+    case Stats::VerifiedFiles:
+        return "verifiedFiles";
+    case Stats::VerifyRegressions:
+        return "verifyRegressions";
+    case Stats::ClosuresScanned:
+        return "closuresScanned";
+    case Stats::ClosuresCached:
+        return "closuresCached";
+    case Stats::FilesPrefetched:
+        return "filesPrefetched";
+    case Stats::AsyncWrites:
+        return "asyncWrites";
+    case Stats::ReadBlockedUs:
+        return "readBlockedUs";
+    case Stats::WriteBlockedUs:
+        return "writeBlockedUs";
+    case Stats::ExternalFilesScanned:
+        return "externalFilesScanned";
+    case Stats::ExternalNamesSkipped:
+        return "externalNamesSkipped";
+    case Stats::PolicyEvaluations:
+        return "policyEvaluations";
+    case Stats::FsStatCalls:
+        return "fsStatCalls";
+    case Stats::FsOpenCalls:
+        return "fsOpenCalls";
+    case Stats::FsDirListings:
+        return "fsDirListings";
+    case Stats::StatCacheHits:
+        return "statCacheHits";
+    case Stats::ContentCacheHits:
+        return "contentCacheHits";
+    case Stats::DirCacheHits:
+        return "dirCacheHits";
+    case Stats::MappingsDropped:
+        return "mappingsDropped";
+    case Stats::MappingsMoved:
+        return "mappingsMoved";
+    case Stats::BaseMapHits:
+        return "baseMapHits";
+    case Stats::UnityChunkSources:
+        return "unityChunkSources";
+    case Stats::NumCounters:
+        break;
+    }
+    return "unknown";
+}
+
+void Stats::addPhase(llvm::StringRef phase, double ms) {
+    std::lock_guard<std::mutex> lock(mutex);
+    for (auto &entry : phases) {
+        if (entry.first == phase) {
+            entry.second += ms;
+            return;
+        }
+    }
+    phases.emplace_back(phase.str(), ms);
+}
+
+void Stats::addTU(TUTimings timings) {
+    std::lock_guard<std::mutex> lock(mutex);
+    tus.push_back(std::move(timings));
+}
+
+std::vector<Stats::TUTimings> Stats::getTUs() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return tus;
+}
+
+void Stats::addStage(StageStats stage) {
+    std::lock_guard<std::mutex> lock(mutex);
+    stages.push_back(std::move(stage));
+}
+
+void Stats::writeJSON(llvm::raw_ostream &os) const {
+    std::lock_guard<std::mutex> lock(mutex);
+    llvm::json::OStream json(os, 2);
+
+    json.object([&] {
+        json.attributeObject("counters", [&] {
+            for (int i = 0; i < NumCounters; ++i) {
+                Counter counter = static_cast<Counter>(i);
+                json.attribute(counterName(counter), get(counter));
+            }
+        });
+        json.attributeObject("phasesMs", [&] {
+            for (const auto &[phase, ms] : phases)
+                json.attribute(phase, ms);
+        });
+        json.attributeArray("translationUnits", [&] {
+            for (const auto &tu : tus) {
+                json.object([&] {
+                    json.attribute("file", tu.file);
+                    json.attribute("parseMs", tu.parseMs);
+                    json.attribute("traverseMs", tu.traverseMs);
+                    json.attribute("rewriteMs", tu.rewriteMs);
+                });
+            }
+        });
+        if (!stages.empty()) {
+            json.attributeArray("pipelineStages", [&] {
+                for (const auto &stage : stages) {
+                    json.object([&] {
+                        json.attribute("stage", stage.name);
+                        json.attribute("workers", stage.workers);
+                        json.attribute("capacity", uint64_t(stage.capacity));
+                        json.attribute("items", stage.items);
+                        json.attribute("meanDepth", stage.meanDepth);
+                        json.attribute("maxDepth", uint64_t(stage.maxDepth));
+                        json.attribute("producerBlockedMs",
+                                       stage.producerBlockedMs);
+                        json.attribute("busyMs", stage.busyMs);
+                        json.attribute("idleMs", stage.idleMs);
+                    });
+                }
+            });
+        }
+        for (const auto &[phase, ms] : phases) {
+            uint64_t bytes = get(CompressionInputBytes);
+            if (phase == "compress" && ms > 0 && bytes)
+                json.attribute("compressionMBps", bytes / 1e3 / ms);
+        }
+        json.attribute("peakRSSKB", getPeakRSSKB());
+    });
+    os << "\n";
+}
+
+uint64_t getPeakRSSKB() {
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0)
+        return 0;
+#ifdef __APPLE__
+    return usage.ru_maxrss / 1024; // bytes on macOS
+#else
+    return usage.ru_maxrss;
+#endif
+}
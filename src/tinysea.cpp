@@ -0,0 +1,59 @@
+#include "stdafx.h"
+#include "tinysea.h"
+
+using namespace clang;
+using namespace clang::tooling;
+
+namespace tinysea {
+
+Session::Session() : renamer(std::make_unique<Renamer>()) {}
+Session::~Session() = default;
+Session::Session(Session &&) = default;
+Session &Session::operator=(Session &&) = default;
+
+void Session::loadMappings(const std::string &filename) {
+    renamer->loadMappings(filename);
+}
+
+void Session::saveMappings(const std::string &filename) {
+    renamer->saveMappings(filename);
+}
+
+RewriteResult Session::rewrite(const RewriteRequest &request) {
+    RewriteResult result;
+
+    FixedCompilationDatabase db(request.workingDirectory, request.args);
+
+    std::vector<std::string> paths;
+    for (const auto &source : request.sources)
+        paths.push_back(source.path);
+
+    // mapped files live in an in-memory overlay on top of the real file
+    // system, so system headers still come from disk but nothing is written
+    ClangTool tool(db, paths);
+    for (const auto &source : request.sources)
+        tool.mapVirtualFile(source.path, source.content);
+    for (const auto &header : request.headers)
+        tool.mapVirtualFile(header.path, header.content);
+
+    llvm::raw_string_ostream diagnostics(result.diagnostics);
+    TextDiagnosticPrinter printer(diagnostics, new DiagnosticOptions());
+    tool.setDiagnosticConsumer(&printer);
+
+    ToolOptions options;
+    options.inMemoryOutput = true;
+    options.stripWhitespace = request.stripWhitespace;
+    options.minifyLiterals = request.minifyLiterals;
+    CustomActionFactory factory(*renamer, options);
+    result.success = tool.run(&factory) == 0;
+    diagnostics.flush();
+
+    for (auto &[path, content] : renamer->takeRewrittenFiles())
+        result.files.push_back({path, std::move(content)});
+    result.combinedOutput = renamer->takeCombinedOutput();
+    result.newMappings = renamer->takeNewMappings();
+
+    return result;
+}
+
+} // namespace tinysea
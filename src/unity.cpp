@@ -0,0 +1,132 @@
+#include "stdafx.h"
+
+namespace {
+
+// files are numbered so closures are id lists and chunk contents bit sets
+class ClosureTable {
+    const IncludeGraph &graph;
+    llvm::StringMap<unsigned> ids;
+
+public:
+    std::vector<uint64_t> sizes;
+
+    explicit ClosureTable(const IncludeGraph &graph) : graph(graph) {}
+
+    unsigned id(llvm::StringRef path) {
+        auto [it, inserted] = ids.try_emplace(path, sizes.size());
+        if (inserted) {
+            uint64_t size = 0;
+            llvm::sys::fs::file_size(path, size);
+            sizes.push_back(size);
+        }
+        return it->second;
+    }
+
+    // every file `main` includes, directly or not, system headers too
+    std::vector<unsigned> closure(const std::string &main) {
+        std::vector<unsigned> files;
+        llvm::StringSet<> seen{main};
+        std::vector<std::string> stack{main};
+        while (!stack.empty()) {
+            std::string path = std::move(stack.back());
+            stack.pop_back();
+            auto it = graph.find(path);
+            if (it == graph.end())
+                continue;
+            for (const auto &[line, directive] : it->second.directives) {
+                if (!seen.insert(directive.target).second)
+                    continue;
+                files.push_back(id(directive.target));
+                stack.push_back(directive.target);
+            }
+        }
+        return files;
+    }
+};
+
+} // namespace
+
+std::vector<UnityChunk>
+planUnityChunks(const std::vector<std::string> &sources,
+                const std::vector<Stats::TUTimings> &tus,
+                const IncludeGraph &graph, unsigned count) {
+    llvm::StringMap<double> parseMs;
+    double total = 0;
+    for (const auto &tu : tus) {
+        parseMs[normalizedPath(tu.file)] += tu.parseMs;
+        total += tu.parseMs;
+    }
+    double mean = tus.empty() ? 1 : total / tus.size();
+
+    struct Source {
+        std::string path;
+        double cost;
+        uint64_t ownBytes = 0;
+        std::vector<unsigned> closure;
+    };
+    ClosureTable table(graph);
+    std::vector<Source> pending;
+    for (const std::string &source : sources) {
+        std::string path = normalizedPath(source);
+        auto it = parseMs.find(path);
+        Source entry{source, it != parseMs.end() ? it->second : mean};
+        llvm::sys::fs::file_size(path, entry.ownBytes);
+        entry.closure = table.closure(path);
+        pending.push_back(std::move(entry));
+    }
+    llvm::stable_sort(pending, [](const Source &a, const Source &b) {
+        return a.cost > b.cost;
+    });
+
+    std::vector<UnityChunk> chunks(std::max(1u, count));
+    std::vector<llvm::BitVector> parsed(chunks.size(),
+                                        llvm::BitVector(table.sizes.size()));
+    for (const Source &source : pending) {
+        uint64_t closureBytes = source.ownBytes;
+        for (unsigned file : source.closure)
+            closureBytes += table.sizes[file];
+
+        size_t best = 0;
+        double bestAdded = 0;
+        for (size_t i = 0; i < chunks.size(); ++i) {
+            uint64_t shared = 0;
+            for (unsigned file : source.closure) {
+                if (parsed[i].test(file))
+                    shared += table.sizes[file];
+            }
+            double added =
+                closureBytes
+                    ? source.cost * (1 - double(shared) / closureBytes)
+                    : source.cost;
+            if (i == 0 ||
+                chunks[i].cost + added < chunks[best].cost + bestAdded) {
+                best = i;
+                bestAdded = added;
+            }
+        }
+
+        chunks[best].sources.push_back(source.path);
+        chunks[best].cost += bestAdded;
+        for (unsigned file : source.closure)
+            parsed[best].set(file);
+    }
+
+    // within a chunk, sources keep the order the project lists them in
+    llvm::StringMap<size_t> order;
+    for (size_t i = 0; i < sources.size(); ++i)
+        order[sources[i]] = i;
+    for (UnityChunk &chunk : chunks) {
+        llvm::sort(chunk.sources, [&](const std::string &a,
+                                      const std::string &b) {
+            return order[a] < order[b];
+        });
+    }
+    return chunks;
+}
+
+std::string unityChunkPath(llvm::StringRef output, unsigned index) {
+    llvm::StringRef extension = llvm::sys::path::extension(output);
+    return (output.drop_back(extension.size()) + "." + llvm::Twine(index) +
+            extension)
+        .str();
+}
@@ -0,0 +1,130 @@
+#include "stdafx.h"
+
+using namespace clang;
+using namespace clang::tooling;
+
+namespace {
+
+enum class Version { Original, Rewritten };
+
+const std::string &contents(const BufferVersions &buffer, Version version) {
+    return version == Version::Original ? buffer.original : buffer.rewritten;
+}
+
+// One -fsyntax-only run over `file` with every buffer mapped in at the
+// chosen version. The tool maps the strings in place rather than copying
+// them, so `buffers` must outlive the run. Checks run in parallel, so the
+// tool gets a file system with its own working directory rather than the
+// process-wide one.
+bool syntaxCheck(const CompilationDatabase &compilations,
+                 const std::string &file,
+                 const std::map<std::string, BufferVersions> &buffers,
+                 Version version, std::string &diagnostics) {
+    ClangTool tool(compilations, {file},
+                   std::make_shared<PCHContainerOperations>(),
+                   llvm::vfs::createPhysicalFileSystem());
+    for (const auto &[path, buffer] : buffers)
+        tool.mapVirtualFile(path, contents(buffer, version));
+
+    llvm::raw_string_ostream os(diagnostics);
+    TextDiagnosticPrinter printer(os, new DiagnosticOptions());
+    tool.setDiagnosticConsumer(&printer);
+    tool.setPrintErrorMessage(false);
+
+    auto factory = newFrontendActionFactory<SyntaxOnlyAction>();
+    return tool.run(factory.get()) == 0;
+}
+
+bool syntaxCheck(const std::string &code, const std::string &filename,
+                 const std::vector<std::string> &args,
+                 std::string &diagnostics) {
+    auto overlay = llvm::makeIntrusiveRefCnt<llvm::vfs::OverlayFileSystem>(
+        llvm::vfs::getRealFileSystem());
+    auto memory = llvm::makeIntrusiveRefCnt<llvm::vfs::InMemoryFileSystem>();
+    overlay->pushOverlay(memory);
+    memory->addFile(filename, 0, llvm::MemoryBuffer::getMemBuffer(code));
+    auto files = llvm::makeIntrusiveRefCnt<FileManager>(FileSystemOptions(),
+                                                        overlay);
+
+    std::vector<std::string> commandLine = {"tinysea", "-fsyntax-only"};
+    commandLine.insert(commandLine.end(), args.begin(), args.end());
+    commandLine.push_back(filename);
+
+    llvm::raw_string_ostream os(diagnostics);
+    TextDiagnosticPrinter printer(os, new DiagnosticOptions());
+    ToolInvocation invocation(commandLine, std::make_unique<SyntaxOnlyAction>(),
+                              files.get());
+    invocation.setDiagnosticConsumer(&printer);
+    return invocation.run();
+}
+
+void reportRegression(const std::string &file,
+                      const std::string &diagnostics) {
+    llvm::errs() << "verify: " << file
+                 << ": rewritten source fails to compile, original compiles\n"
+                 << diagnostics;
+}
+
+} // namespace
+
+unsigned verifyRewrites(const CompilationDatabase &compilations,
+                        const std::vector<std::string> &sources,
+                        const std::map<std::string, BufferVersions> &buffers,
+                        unsigned jobs, Stats &stats) {
+    double verifyMs = 0;
+    // one slot per source so the report comes out in a stable order
+    std::vector<std::optional<std::string>> regressions(sources.size());
+    {
+        PhaseTimer timer("Verify", verifyMs);
+        llvm::ThreadPool pool(llvm::hardware_concurrency(jobs));
+        for (size_t i = 0; i < sources.size(); ++i) {
+            pool.async([&, i] {
+                stats.add(Stats::VerifiedFiles);
+                std::string diagnostics;
+                if (syntaxCheck(compilations, sources[i], buffers,
+                                Version::Rewritten, diagnostics))
+                    return;
+
+                // only worth checking the original once the rewrite failed
+                std::string originalDiagnostics;
+                if (syntaxCheck(compilations, sources[i], buffers,
+                                Version::Original, originalDiagnostics))
+                    regressions[i] = std::move(diagnostics);
+            });
+        }
+        pool.wait();
+    }
+    stats.addPhase("verify", verifyMs);
+
+    unsigned count = 0;
+    for (size_t i = 0; i < sources.size(); ++i) {
+        if (!regressions[i])
+            continue;
+        reportRegression(sources[i], *regressions[i]);
+        ++count;
+    }
+    stats.add(Stats::VerifyRegressions, count);
+    return count;
+}
+
+bool verifyRewrite(const BufferVersions &buffer, const std::string &filename,
+                   const std::vector<std::string> &args, Stats &stats) {
+    double verifyMs = 0;
+    bool ok;
+    std::string diagnostics;
+    {
+        PhaseTimer timer("Verify", verifyMs, filename);
+        stats.add(Stats::VerifiedFiles);
+        std::string originalDiagnostics;
+        ok = syntaxCheck(buffer.rewritten, filename, args, diagnostics) ||
+             !syntaxCheck(buffer.original, filename, args,
+                          originalDiagnostics);
+    }
+    stats.addPhase("verify", verifyMs);
+
+    if (!ok) {
+        reportRegression(filename, diagnostics);
+        stats.add(Stats::VerifyRegressions);
+    }
+    return ok;
+}
@@ -0,0 +1,24 @@
+#include "shared.h"
+
+#define BUF 16
+
+namespace {
+using Count = int;
+
+struct Scratch {
+    Count data[BUF];
+    Scratch() : data{} {}
+    ~Scratch() {}
+    Count first() const { return data[0]; }
+};
+} // namespace
+
+int sharedTotal = 0;
+
+static int clamp(int value) { return value > 100 ? 100 : value; }
+
+int addToTotal(int amount) {
+    Scratch scratch;
+    sharedTotal += clamp(twice(amount)) + scratch.first();
+    return sharedTotal;
+}
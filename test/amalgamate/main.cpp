@@ -0,0 +1,20 @@
+#include "shared.h"
+
+#define BUF 4
+
+// the same names as in counter.cpp, meaning something else
+namespace {
+using Count = long;
+
+struct Scratch {
+    Count total = BUF;
+};
+} // namespace
+
+static int clamp(int value) { return value < 0 ? 0 : value; }
+
+int main() {
+    Scratch scratch;
+    scratch.total += addToTotal(clamp(ColorGreen));
+    return scratch.total == sharedTotal + BUF ? 0 : 1;
+}
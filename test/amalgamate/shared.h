@@ -0,0 +1,9 @@
+#pragma once
+
+// declared here, defined in counter.cpp and used from both sources
+enum Color { ColorRed, ColorGreen, ColorBlue };
+
+extern int sharedTotal;
+int addToTotal(int amount);
+
+inline int twice(int value) { return value + value; }
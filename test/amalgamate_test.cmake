@@ -0,0 +1,74 @@
+# Runs tinysea --amalgamate over the project in FIXTURE and checks that
+# every file it writes compiles. Called by ctest as
+#
+#   cmake -DTINYSEA=<exe> -DCOMPILER=<c++> -DFIXTURE=<dir> -DWORK_DIR=<dir>
+#         [-DARGS=<arg,...>] [-DRENAMED=<name,...>] -P amalgamate_test.cmake
+#
+# The fixture is copied to WORK_DIR next to a generated
+# compile_commands.json, so the checked-in sources are never touched.
+# Identifiers listed in RENAMED must not survive anywhere in the output.
+
+foreach(var TINYSEA COMPILER FIXTURE WORK_DIR)
+    if(NOT DEFINED ${var})
+        message(FATAL_ERROR "${var} not set")
+    endif()
+endforeach()
+
+file(REMOVE_RECURSE "${WORK_DIR}")
+file(MAKE_DIRECTORY "${WORK_DIR}")
+file(GLOB fixtureFiles "${FIXTURE}/*")
+file(COPY ${fixtureFiles} DESTINATION "${WORK_DIR}")
+
+file(GLOB sources RELATIVE "${WORK_DIR}" "${WORK_DIR}/*.cpp")
+list(SORT sources)
+set(commands)
+foreach(source IN LISTS sources)
+    string(CONCAT command
+        "  {\"directory\": \"${WORK_DIR}\", "
+        "\"file\": \"${WORK_DIR}/${source}\", "
+        "\"command\": \"c++ -std=c++20 -c ${source}\"}")
+    list(APPEND commands "${command}")
+endforeach()
+string(JOIN ",\n" commands ${commands})
+file(WRITE "${WORK_DIR}/compile_commands.json" "[\n${commands}\n]\n")
+
+string(REPLACE "," ";" args "${ARGS}")
+set(output "${WORK_DIR}/amalgamated.cpp")
+execute_process(
+    COMMAND "${TINYSEA}" "--cmake-project=${WORK_DIR}" --amalgamate
+            "--output=${output}" ${args}
+    WORKING_DIRECTORY "${WORK_DIR}"
+    RESULT_VARIABLE result
+    ERROR_VARIABLE errors
+)
+if(NOT result EQUAL 0)
+    message(FATAL_ERROR "tinysea failed (${result}):\n${errors}")
+endif()
+
+# with --unity-chunks the output is amalgamated.<n>.cpp instead
+file(GLOB outputs "${WORK_DIR}/amalgamated*.cpp")
+if(NOT outputs)
+    message(FATAL_ERROR "tinysea wrote no output:\n${errors}")
+endif()
+
+string(REPLACE "," ";" renamed "${RENAMED}")
+foreach(output IN LISTS outputs)
+    get_filename_component(name "${output}" NAME)
+    execute_process(
+        COMMAND "${COMPILER}" -std=c++20 -fsyntax-only -Werror
+                -x c++ "${output}"
+        RESULT_VARIABLE outputResult
+        ERROR_VARIABLE outputErrors
+    )
+    if(NOT outputResult EQUAL 0)
+        message(FATAL_ERROR "${name} doesn't compile:\n${outputErrors}")
+    endif()
+
+    file(READ "${output}" amalgamated)
+    foreach(identifier IN LISTS renamed)
+        set(word "(^|[^A-Za-z0-9_])${identifier}([^A-Za-z0-9_]|$)")
+        if(amalgamated MATCHES "${word}")
+            message(FATAL_ERROR "${identifier} was not renamed in ${name}")
+        endif()
+    endforeach()
+endforeach()
@@ -0,0 +1,70 @@
+#include "stdafx.h"
+#include "tinysea.h"
+
+// --minify-literals through the in-process API: each literal below has a
+// known shortest spelling, and those under a ud-suffix (the <chrono>
+// literals, which have no underscore) must be left alone. Members keep
+// their names, so the literals are the only thing that changes.
+
+static const char *source = R"(#include <chrono>
+using namespace std::chrono_literals;
+
+struct Literals {
+    int hex = 0x0010;
+    unsigned all = 4294967295u;
+    long long wide = 0x0000001LL;
+    int grouped = 1'000'000;
+    int truth = true;
+    float single = 1.500f;
+    double large = 1500.0;
+    long double extended = 2.50L;
+
+    long double hours() const { return (1.0000h).count(); }
+    long double minutes() const { return (2.50min).count(); }
+    long long seconds() const { return (0x0010s).count(); }
+};
+)";
+
+static const char *expected = R"(#include <chrono>
+using namespace std::chrono_literals;
+
+struct Literals {
+    int hex = 16;
+    unsigned all = 0xffffffff;
+    long long wide = 1ll;
+    int grouped = 1000000;
+    int truth = 1;
+    float single = 1.5f;
+    double large = 15e2;
+    long double extended = 2.5l;
+
+    long double hours() const { return (1.0000h).count(); }
+    long double minutes() const { return (2.50min).count(); }
+    long long seconds() const { return (0x0010s).count(); }
+};
+)";
+
+int main() {
+    tinysea::Session session;
+    tinysea::RewriteRequest request;
+    request.sources.push_back({"literals.cpp", source});
+    request.args = {"-std=c++20"};
+    request.minifyLiterals = true;
+
+    tinysea::RewriteResult result = session.rewrite(request);
+    if (!result.success || result.files.size() != 1) {
+        llvm::errs() << "FAILED: rewrite (" << result.files.size()
+                     << " files)\n"
+                     << result.diagnostics;
+        return 1;
+    }
+
+    const std::string &rewritten = result.files.front().content;
+    if (rewritten != expected) {
+        llvm::errs() << "FAILED: literals\n--- expected\n"
+                     << expected << "--- got\n"
+                     << rewritten;
+        return 1;
+    }
+    return 0;
+}
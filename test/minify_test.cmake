@@ -0,0 +1,78 @@
+# Runs tinysea --strip-whitespace --verify over SOURCE through --stdin and
+# checks the result still compiles. Called by ctest as
+#
+#   cmake -DTINYSEA=<exe> -DCOMPILER=<c++> -DSOURCE=<file> -DOUTPUT=<file>
+#         [-DINCLUDE_DIR=<dir>] [-DRENAMED=<name,...>] -P minify_test.cmake
+#
+# A source the compiler rejects as it stands must be refused by tinysea too,
+# rather than come back half renamed. Identifiers listed in RENAMED must not
+# survive anywhere in the output.
+
+foreach(var TINYSEA COMPILER SOURCE OUTPUT)
+    if(NOT DEFINED ${var})
+        message(FATAL_ERROR "${var} not set")
+    endif()
+endforeach()
+
+get_filename_component(name "${SOURCE}" NAME)
+get_filename_component(outputDir "${OUTPUT}" DIRECTORY)
+file(MAKE_DIRECTORY "${outputDir}")
+
+set(includeArgs)
+set(extraArgs)
+if(INCLUDE_DIR)
+    set(includeArgs "-I${INCLUDE_DIR}")
+    set(extraArgs "--stdin-extra-arg=-I${INCLUDE_DIR}")
+endif()
+
+execute_process(
+    COMMAND "${COMPILER}" -std=c++20 -fsyntax-only ${includeArgs}
+            -x c++ "${SOURCE}"
+    RESULT_VARIABLE originalResult
+    OUTPUT_QUIET ERROR_QUIET
+)
+
+execute_process(
+    COMMAND "${TINYSEA}" --stdin "--stdin-filename=${name}"
+            --strip-whitespace --verify ${extraArgs}
+    INPUT_FILE "${SOURCE}"
+    OUTPUT_FILE "${OUTPUT}"
+    RESULT_VARIABLE result
+    ERROR_VARIABLE errors
+)
+
+if(NOT originalResult EQUAL 0)
+    if(result EQUAL 0)
+        message(FATAL_ERROR
+            "${name} doesn't compile, but tinysea rewrote it anyway")
+    endif()
+    message(STATUS "${name} doesn't compile as it stands; tinysea refused it")
+    return()
+endif()
+
+if(NOT result EQUAL 0)
+    message(FATAL_ERROR "tinysea failed on ${name} (${result}):\n${errors}")
+endif()
+
+execute_process(
+    COMMAND "${COMPILER}" -std=c++20 -fsyntax-only ${includeArgs}
+            -x c++ "${OUTPUT}"
+    RESULT_VARIABLE outputResult
+    ERROR_VARIABLE outputErrors
+)
+if(NOT outputResult EQUAL 0)
+    message(FATAL_ERROR
+        "minified ${name} no longer compiles:\n${outputErrors}")
+endif()
+
+file(READ "${OUTPUT}" minified)
+string(REPLACE "," ";" renamed "${RENAMED}")
+foreach(identifier IN LISTS renamed)
+    if(minified MATCHES "(^|[^A-Za-z0-9_])${identifier}([^A-Za-z0-9_]|$)")
+        message(FATAL_ERROR "${identifier} was not renamed in ${name}")
+    endif()
+endforeach()
+
+file(SIZE "${SOURCE}" sourceSize)
+file(SIZE "${OUTPUT}" outputSize)
+message(STATUS "${name}: ${sourceSize} -> ${outputSize} bytes")
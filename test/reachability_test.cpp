@@ -0,0 +1,71 @@
+#include "stdafx.h"
+
+// --dead-code-elim on marked-up text: main calls helper, nothing calls
+// unused, so unused is blanked while every line break and its #define
+// survive, and the markers are gone either way. Prints every check that
+// fails and exits 1 if any did.
+
+static int failures = 0;
+
+static void check(bool condition, const llvm::Twine &what) {
+    if (condition)
+        return;
+    llvm::errs() << "FAILED: " << what << "\n";
+    ++failures;
+}
+
+static std::string section(const std::string &owner, llvm::StringRef body) {
+    return sectionBeginMarker(owner) + body.str() + sectionEndMarker;
+}
+
+int main() {
+    ReferenceGraph graph;
+    graph.addRoot("main");
+    graph.addEdge("main", "helper");
+    graph.addEdge("unused", "helper");
+    std::unordered_set<std::string> live = graph.reachable();
+    check(live.count("main") && live.count("helper"), "main and helper live");
+    check(!live.count("unused"), "unused not reachable");
+
+    std::string text = section("main", "int main() { return helper(); }") +
+                       "\n" +
+                       section("helper", "int helper() {\n"
+                                         "    return 1;\n"
+                                         "}") +
+                       "\n" +
+                       section("unused", "int unused() {\n"
+                                         "#define UNUSED_LIMIT 3\n"
+                                         "    return UNUSED_LIMIT;\n"
+                                         "}") +
+                       "\n";
+    const std::string expected = "int main() { return helper(); }\n"
+                                 "int helper() {\n"
+                                 "    return 1;\n"
+                                 "}\n"
+                                 "\n"
+                                 "#define UNUSED_LIMIT 3\n"
+                                 "\n"
+                                 "\n";
+    size_t lines = llvm::count(text, '\n');
+
+    std::set<std::string> dropped;
+    std::optional<size_t> removed = removeDeadSections(text, live, dropped);
+    check(removed.has_value(), "markers found");
+    check(text == expected, "output\n--- expected\n" + expected +
+                                "--- got\n" + text);
+    check(size_t(llvm::count(text, '\n')) == lines, "line count unchanged");
+    check(dropped == std::set<std::string>{"unused"}, "dropped sections");
+    check(removed == std::strlen("int unused() {") +
+                         std::strlen("    return UNUSED_LIMIT;") +
+                         std::strlen("}"),
+          "bytes removed");
+
+    // text without markers is left alone
+    std::string plain = "int kept;\n";
+    check(!removeDeadSections(plain, live, dropped) && plain == "int kept;\n",
+          "unmarked text");
+
+    if (failures)
+        llvm::errs() << failures << " check(s) failed\n";
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,39 @@
+// every kind of use that has to follow a renamed declaration
+enum Mode { ModeFast, ModeSlow };
+
+namespace geometry {
+int scaleFactor = 3;
+int scale(int value) { return value * scaleFactor; }
+template <typename T> T twice(T value) { return value + value; }
+} // namespace geometry
+
+using geometry::scale;
+
+struct Point {
+    int x;
+    int y;
+    int sum() const { return x + y; }
+};
+
+static int counter = 0;
+
+int accumulate(const Point &point, Mode mode) {
+    int total = point.sum();
+    auto add = [&total, mode](int amount) {
+        total += mode == ModeFast ? amount : amount / 2;
+    };
+    add(scale(point.x));
+    add(geometry::twice(point.y));
+    for (int index = 0; index < 3; ++index)
+        counter += index;
+    return total + counter;
+}
+
+template <typename... Values> int countValues(Values... values) {
+    return sizeof...(values);
+}
+
+int main() {
+    Point origin{1, 2};
+    return accumulate(origin, ModeSlow) + countValues(1, 2, 3) > 0 ? 0 : 1;
+}
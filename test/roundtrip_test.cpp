@@ -0,0 +1,151 @@
+#include "stdafx.h"
+
+// Round trips of the on-disk formats: the framed container written by
+// --output-compression and the TSMI mapping index, versions 1 and 2.
+// Prints every check that fails and exits 1 if any did.
+
+using Mapping = std::unordered_map<std::string, std::string>;
+
+static int failures = 0;
+
+static void check(bool condition, const llvm::Twine &what) {
+    if (condition)
+        return;
+    llvm::errs() << "FAILED: " << what << "\n";
+    ++failures;
+}
+
+static void roundTripFrames(OutputCompression compression,
+                            const llvm::Twine &label) {
+    if (const char *reason = compressionUnsupportedReason(compression)) {
+        llvm::outs() << "skipping " << label << ": " << reason << "\n";
+        return;
+    }
+
+    // an empty frame, one that doesn't compress and one that does
+    std::vector<std::pair<std::string, std::string>> frames = {
+        {"empty.cpp", ""},
+        {"short.cpp", "int a;"},
+        {"long.cpp", std::string(4096, 'x') + "\nint b(){return 0;}\n"},
+    };
+
+    std::string file;
+    {
+        llvm::raw_string_ostream os(file);
+        FramedWriter writer(os, compression);
+        for (const auto &[name, data] : frames)
+            writer.addFrame(name, data);
+        writer.finish();
+    }
+
+    check(isFramed(file), label + ": isFramed");
+    auto index = readFrameIndex(file);
+    check(index && index->size() == frames.size(), label + ": frame index");
+    if (!index || index->size() != frames.size())
+        return;
+
+    for (size_t i = 0; i < frames.size(); ++i) {
+        std::string out;
+        check((*index)[i].name == frames[i].first,
+              label + ": name of frame " + llvm::Twine(i));
+        check(readFrame(file, (*index)[i].offset, out) &&
+                  out == frames[i].second,
+              label + ": contents of " + frames[i].first);
+    }
+
+    // a damaged trailer is refused rather than read past the end
+    std::string truncated = file.substr(0, file.size() - 1);
+    check(!isFramed(truncated), label + ": truncated file still framed");
+}
+
+static std::string temporaryPath(llvm::StringRef prefix) {
+    llvm::SmallString<128> path;
+    if (auto ec = llvm::sys::fs::createTemporaryFile(prefix, "idx", path)) {
+        llvm::errs() << "Failed to create a temporary file: " << ec.message()
+                     << "\n";
+        std::exit(1);
+    }
+    return std::string(path);
+}
+
+static void checkLookups(const MappingIndex &index, const Mapping &map,
+                         const llvm::Twine &label) {
+    check(index.size() == map.size(), label + ": entry count");
+    for (const auto &[key, shortName] : map) {
+        check(index.shortName(key) == shortName, label + ": shortName " + key);
+        check(index.original(shortName) == key, label + ": original " + key);
+    }
+    check(index.shortName("::notMapped").empty(), label + ": unknown key");
+    check(index.original("zzzzzzzz").empty(), label + ": unknown short name");
+}
+
+static void roundTripMappingIndex() {
+    Mapping map;
+    for (unsigned i = 0; i < 100; ++i)
+        map["ns::name" + std::to_string(i)] = "n" + std::to_string(i);
+    map["#MACRO"] = "M";
+
+    std::string path = temporaryPath("tinysea-v2");
+    check(MappingIndex::write(map, path, /*nameEnd=*/123), "write v2 index");
+    auto index = MappingIndex::open(path);
+    check(index != nullptr, "open v2 index");
+    if (index) {
+        checkLookups(*index, map, "v2");
+        check(index->nameEnd() == 123, "v2: nameEnd");
+    }
+
+    // a version 1 file is the same without nameEnd in the header
+    auto buffer = llvm::MemoryBuffer::getFile(path, /*IsText=*/false,
+                                              /*RequiresNullTerminator=*/false);
+    check(bool(buffer), "read back v2 index");
+    if (buffer) {
+        std::string v1 = (*buffer)->getBuffer().str();
+        v1[4] = 1;
+        v1.erase(28, 4);
+
+        std::string v1Path = temporaryPath("tinysea-v1");
+        std::error_code ec;
+        {
+            llvm::raw_fd_ostream os(v1Path, ec);
+            os << v1;
+        }
+        check(!ec, "write v1 index");
+        auto v1Index = MappingIndex::open(v1Path);
+        check(v1Index != nullptr, "open v1 index");
+        if (v1Index) {
+            checkLookups(*v1Index, map, "v1");
+            check(v1Index->nameEnd() == 0, "v1: nameEnd");
+        }
+
+        // and a header that claims a version we don't know is refused
+        v1[4] = 9;
+        {
+            llvm::raw_fd_ostream os(v1Path, ec);
+            os << v1;
+        }
+        check(MappingIndex::open(v1Path) == nullptr, "unknown version opened");
+        llvm::sys::fs::remove(v1Path);
+    }
+    llvm::sys::fs::remove(path);
+
+    // an empty mapping still makes a valid index
+    Mapping empty;
+    std::string emptyPath = temporaryPath("tinysea-empty");
+    check(MappingIndex::write(empty, emptyPath), "write empty index");
+    auto emptyIndex = MappingIndex::open(emptyPath);
+    check(emptyIndex && emptyIndex->size() == 0 &&
+              emptyIndex->original("a").empty(),
+          "empty index");
+    llvm::sys::fs::remove(emptyPath);
+}
+
+int main() {
+    roundTripFrames(OutputCompression::None, "stored");
+    roundTripFrames(OutputCompression::Zlib, "zlib");
+    roundTripFrames(OutputCompression::Zstd, "zstd");
+    roundTripMappingIndex();
+
+    if (failures)
+        llvm::errs() << failures << " check(s) failed\n";
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,71 @@
+#include "stdafx.h"
+#include "tinysea.h"
+
+// tinysea::Session on an in-memory buffer: the rewritten text and the
+// mapping entries the call created, then a second call on the same session
+// that reuses those names and creates none. Prints every check that fails
+// and exits 1 if any did.
+
+using Mapping = std::vector<std::pair<std::string, std::string>>;
+
+static int failures = 0;
+
+static void check(bool condition, const llvm::Twine &what) {
+    if (condition)
+        return;
+    llvm::errs() << "FAILED: " << what << "\n";
+    ++failures;
+}
+
+static const char *source = R"(int sharedCount = 0;
+
+void increment() { sharedCount += 2; }
+
+int main() {
+    increment();
+    return sharedCount;
+}
+)";
+
+static const char *expected = R"(int a = 0;
+
+void b() { a += 2; }
+
+int main() {
+    b();
+    return a;
+}
+)";
+
+static tinysea::RewriteResult rewrite(tinysea::Session &session,
+                                      const llvm::Twine &label) {
+    tinysea::RewriteRequest request;
+    request.sources.push_back({"session.cpp", source});
+    request.args = {"-std=c++20"};
+
+    tinysea::RewriteResult result = session.rewrite(request);
+    check(result.success, label + ": rewrite\n" + result.diagnostics);
+    check(result.files.size() == 1, label + ": one rewritten file");
+    if (result.files.size() == 1) {
+        const std::string &rewritten = result.files.front().content;
+        check(rewritten == expected, label + ": output\n--- expected\n" +
+                                         expected + "--- got\n" + rewritten);
+    }
+    return result;
+}
+
+int main() {
+    tinysea::Session session;
+
+    // names are handed out in declaration order; main keeps its own
+    tinysea::RewriteResult first = rewrite(session, "first");
+    Mapping created = {{"sharedCount", "a"}, {"increment", "b"}};
+    check(first.newMappings == created, "first: new mappings");
+
+    tinysea::RewriteResult second = rewrite(session, "second");
+    check(second.newMappings.empty(), "second: mapping reused");
+
+    if (failures)
+        llvm::errs() << failures << " check(s) failed\n";
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,105 @@
+#include "stdafx.h"
+
+// --verify on inputs whose outcome is known: a rewrite that still compiles,
+// one that doesn't, and a source that was broken to begin with, through
+// both the --stdin check and the compilation database one.
+
+static int failures = 0;
+
+static void check(bool condition, const llvm::Twine &what) {
+    if (condition)
+        return;
+    llvm::errs() << "FAILED: " << what << "\n";
+    ++failures;
+}
+
+static const char *original = "int total(int count) {\n"
+                              "    int sum = 0;\n"
+                              "    for (int i = 0; i < count; ++i)\n"
+                              "        sum += i;\n"
+                              "    return sum;\n"
+                              "}\n";
+
+// every name renamed consistently
+static const char *passing = "int a(int b) {\n"
+                             "    int c = 0;\n"
+                             "    for (int d = 0; d < b; ++d)\n"
+                             "        c += d;\n"
+                             "    return c;\n"
+                             "}\n";
+
+// a declaration renamed without one of its references
+static const char *regressing = "int a(int b) {\n"
+                                "    int c = 0;\n"
+                                "    for (int d = 0; d < b; ++d)\n"
+                                "        c += d;\n"
+                                "    return sum;\n"
+                                "}\n";
+
+static const char *broken = "int total(int count) { return missing; }\n";
+
+static void verifySingleBuffers() {
+    std::vector<std::string> args = {"-std=c++20"};
+    {
+        Stats stats;
+        check(verifyRewrite({original, passing}, "pass.cpp", args, stats),
+              "stdin: consistent rewrite rejected");
+        check(stats.get(Stats::VerifyRegressions) == 0,
+              "stdin: regression counted for a consistent rewrite");
+    }
+    {
+        Stats stats;
+        check(!verifyRewrite({original, regressing}, "regress.cpp", args,
+                             stats),
+              "stdin: broken rewrite accepted");
+        check(stats.get(Stats::VerifyRegressions) == 1,
+              "stdin: regression not counted");
+    }
+    {
+        // not our doing: the original fails the same way
+        Stats stats;
+        check(verifyRewrite({broken, broken}, "broken.cpp", args, stats),
+              "stdin: source that never compiled reported as a regression");
+    }
+}
+
+static void verifyProject() {
+    llvm::SmallString<128> dir;
+    if (auto ec = llvm::sys::fs::createUniqueDirectory("tinysea-verify", dir)) {
+        llvm::errs() << "Failed to create a temporary directory: "
+                     << ec.message() << "\n";
+        std::exit(1);
+    }
+
+    // on disk the sources are already rewritten, as after an in-place run;
+    // only the mapped buffers may be compiled
+    std::string pass = normalizedPath(std::string(dir) + "/pass.cpp");
+    std::string regress = normalizedPath(std::string(dir) + "/regress.cpp");
+    check(writeFile(pass, passing) && writeFile(regress, regressing),
+          "write project sources");
+
+    std::map<std::string, BufferVersions> buffers = {
+        {pass, {original, passing}},
+        {regress, {original, regressing}},
+    };
+    FixedCompilationDatabase compilations(dir, {"-std=c++20"});
+    Stats stats;
+    unsigned regressions =
+        verifyRewrites(compilations, {pass, regress}, buffers, 2, stats);
+    check(regressions == 1, "project: expected exactly one regression, got " +
+                                llvm::Twine(regressions));
+    check(stats.get(Stats::VerifiedFiles) == 2, "project: files verified");
+
+    llvm::sys::fs::remove(pass);
+    llvm::sys::fs::remove(regress);
+    llvm::sys::fs::remove(dir);
+}
+
+int main() {
+    verifySingleBuffers();
+    verifyProject();
+
+    if (failures)
+        llvm::errs() << failures << " check(s) failed\n";
+    return failures ? 1 : 0;
+}